@@ -0,0 +1,85 @@
+#include "aho_corasick.h"
+
+#include <cctype>
+#include <queue>
+#include <stdexcept>
+
+TAhoCorasick::TAhoCorasick(const std::vector<std::string>& patterns, bool ignoreAsciiCase)
+{
+    if (patterns.size() > MAX_PATTERNS) {
+        throw std::runtime_error("Too many search terms, maximum is " + std::to_string(MAX_PATTERNS));
+    }
+
+    // Class 0 is for bytes not used in patterns
+    uint8_t usedClasses[256] = {};
+    for (const auto& pattern: patterns) {
+        for (unsigned char c: pattern) {
+            usedClasses[ignoreAsciiCase ? tolower(c) : c] = 1;
+        }
+    }
+    ClassesCount = 1;
+    for (int c = 0; c < 256; ++c) {
+        ByteClass[c] = usedClasses[c] ? ClassesCount++ : 0;
+    }
+    if (ignoreAsciiCase) {
+        for (int c = 'A'; c <= 'Z'; ++c) {
+            ByteClass[c] = ByteClass[tolower(c)];
+        }
+    }
+
+    // Trie of patterns, 0 means no transition as the root can't be a child
+    Transitions.assign(ClassesCount, 0);
+    Outputs.assign(1, 0);
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        uint32_t state = 0;
+        for (unsigned char c: patterns[i]) {
+            auto index = state * ClassesCount + ByteClass[c];
+            if (Transitions[index] == 0) {
+                Transitions[index] = Outputs.size();
+                Outputs.push_back(0);
+                Transitions.resize(Transitions.size() + ClassesCount, 0);
+            }
+            state = Transitions[index];
+        }
+        Outputs[state] |= (uint64_t(1) << i);
+        AllPatterns |= (uint64_t(1) << i);
+    }
+
+    // Breadth-first traversal replaces missing transitions with transitions of the suffix link state
+    std::vector<uint32_t> links(Outputs.size(), 0);
+    std::queue<uint32_t> states;
+    for (size_t c = 0; c < ClassesCount; ++c) {
+        if (Transitions[c] != 0) {
+            states.push(Transitions[c]);
+        }
+    }
+    while (!states.empty()) {
+        auto state = states.front();
+        states.pop();
+        Outputs[state] |= Outputs[links[state]];
+        for (size_t c = 0; c < ClassesCount; ++c) {
+            auto& next = Transitions[state * ClassesCount + c];
+            auto linkNext = Transitions[links[state] * ClassesCount + c];
+            if (next == 0) {
+                next = linkNext;
+            } else {
+                links[next] = linkNext;
+                states.push(next);
+            }
+        }
+    }
+}
+
+uint64_t TAhoCorasick::Find(const char* text, size_t size) const
+{
+    uint64_t res = 0;
+    uint32_t state = 0;
+    for (size_t i = 0; i < size; ++i) {
+        state = Transitions[state * ClassesCount + ByteClass[static_cast<unsigned char>(text[i])]];
+        res |= Outputs[state];
+        if (res == AllPatterns) {
+            break;
+        }
+    }
+    return res;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Aho-Corasick automaton finding a set of byte strings in one pass over a text.
+ *
+ * Transitions are precomputed for every state, so scanning takes one table lookup per byte.
+ * Bytes not present in patterns share one column of the table.
+ */
+class TAhoCorasick
+{
+public:
+    static const size_t MAX_PATTERNS = 64;
+
+    /**
+     * @brief Builds the automaton, throws std::runtime_error if there are too many patterns
+     *
+     * @param patterns non-empty patterns
+     * @param ignoreAsciiCase match ASCII letters regardless of their case
+     */
+    TAhoCorasick(const std::vector<std::string>& patterns, bool ignoreAsciiCase);
+
+    //! Returns a bit mask of patterns found in a text, bit i is set for patterns[i]
+    uint64_t Find(const char* text, size_t size) const;
+
+private:
+    //! Index of a byte column in the transition table
+    uint16_t ByteClass[256];
+    size_t ClassesCount = 0;
+
+    //! ClassesCount transitions per state, the root state is 0
+    std::vector<uint32_t> Transitions;
+
+    //! Patterns ending in a state including ones reachable by suffix links
+    std::vector<uint64_t> Outputs;
+
+    uint64_t AllPatterns = 0;
+};
@@ -0,0 +1,252 @@
+#include "boolean_query.h"
+
+#include "text_search.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include <unicode/unistr.h>
+
+using icu::StringPiece;
+using icu::UnicodeString;
+
+namespace
+{
+    const size_t MAX_QUERY_SIZE = 1024;
+    const size_t MAX_NESTING_DEPTH = 32;
+
+    bool IsSpecialChar(char c)
+    {
+        return isspace(static_cast<unsigned char>(c)) || c == '(' || c == ')' || c == '"';
+    }
+
+    //! Unicode case folding, the same as used for case-insensitive search by pattern
+    std::string FoldCase(const char* text, size_t size)
+    {
+        std::string res;
+        UnicodeString(UnicodeString::fromUTF8(StringPiece(text, size))).foldCase().toUTF8String(res);
+        return res;
+    }
+}
+
+class TBooleanQuery::TParser
+{
+public:
+    TParser(const std::string& query, bool caseSensitive, std::vector<TNode>& nodes)
+        : Query(query),
+          CaseSensitive(caseSensitive),
+          Nodes(nodes)
+    {}
+
+    size_t Parse()
+    {
+        auto res = ParseOr();
+        if (NextToken() != TTokenType::End) {
+            throw Error("unexpected ')'");
+        }
+        return res;
+    }
+
+    const std::vector<std::string>& GetTerms() const
+    {
+        return Terms;
+    }
+
+private:
+    enum class TTokenType
+    {
+        End,
+        Term,
+        And,
+        Or,
+        Not,
+        Open,
+        Close
+    };
+
+    std::runtime_error Error(const std::string& msg) const
+    {
+        return std::runtime_error("Invalid query: " + msg + " at position " + std::to_string(TokenPos));
+    }
+
+    //! Returns type of the next token without consuming it
+    TTokenType PeekToken()
+    {
+        auto pos = Pos;
+        auto res = NextToken();
+        Pos = pos;
+        return res;
+    }
+
+    TTokenType NextToken()
+    {
+        while (Pos < Query.size() && isspace(static_cast<unsigned char>(Query[Pos]))) {
+            ++Pos;
+        }
+        TokenPos = Pos;
+        if (Pos == Query.size()) {
+            return TTokenType::End;
+        }
+        if (Query[Pos] == '(') {
+            ++Pos;
+            return TTokenType::Open;
+        }
+        if (Query[Pos] == ')') {
+            ++Pos;
+            return TTokenType::Close;
+        }
+        Token.clear();
+        if (Query[Pos] == '"') {
+            for (++Pos; Pos < Query.size() && Query[Pos] != '"'; ++Pos) {
+                if (Query[Pos] == '\\' && Pos + 1 < Query.size()) {
+                    ++Pos;
+                }
+                Token += Query[Pos];
+            }
+            if (Pos == Query.size()) {
+                throw Error("unterminated string");
+            }
+            ++Pos;
+            return TTokenType::Term;
+        }
+        for (; Pos < Query.size() && !IsSpecialChar(Query[Pos]); ++Pos) {
+            Token += Query[Pos];
+        }
+        if (Token == "AND") {
+            return TTokenType::And;
+        }
+        if (Token == "OR") {
+            return TTokenType::Or;
+        }
+        if (Token == "NOT") {
+            return TTokenType::Not;
+        }
+        return TTokenType::Term;
+    }
+
+    size_t AddNode(TNodeType type, size_t left, size_t right = 0)
+    {
+        TNode node;
+        node.Type = type;
+        node.Left = left;
+        node.Right = right;
+        Nodes.push_back(node);
+        return Nodes.size() - 1;
+    }
+
+    size_t AddTerm()
+    {
+        if (Token.empty()) {
+            throw Error("empty term");
+        }
+        auto term = CaseSensitive ? Token : FoldCase(Token.data(), Token.size());
+        TNode node;
+        node.Type = TNodeType::Term;
+        node.Term = std::find(Terms.begin(), Terms.end(), term) - Terms.begin();
+        if (node.Term == Terms.size()) {
+            Terms.push_back(term);
+        }
+        Nodes.push_back(node);
+        return Nodes.size() - 1;
+    }
+
+    size_t ParseOr()
+    {
+        auto res = ParseAnd();
+        while (PeekToken() == TTokenType::Or) {
+            NextToken();
+            res = AddNode(TNodeType::Or, res, ParseAnd());
+        }
+        return res;
+    }
+
+    size_t ParseAnd()
+    {
+        auto res = ParseUnary();
+        while (true) {
+            auto token = PeekToken();
+            if (token == TTokenType::And) {
+                NextToken();
+            } else if (token != TTokenType::Term && token != TTokenType::Not && token != TTokenType::Open) {
+                return res;
+            }
+            res = AddNode(TNodeType::And, res, ParseUnary());
+        }
+    }
+
+    size_t ParseUnary()
+    {
+        if (++Depth > MAX_NESTING_DEPTH) {
+            throw Error("too deep nesting");
+        }
+        size_t res;
+        switch (NextToken()) {
+            case TTokenType::Term:
+                res = AddTerm();
+                break;
+            case TTokenType::Not:
+                res = AddNode(TNodeType::Not, ParseUnary());
+                break;
+            case TTokenType::Open:
+                res = ParseOr();
+                if (NextToken() != TTokenType::Close) {
+                    throw Error("expected ')'");
+                }
+                break;
+            default:
+                throw Error("expected a term");
+        }
+        --Depth;
+        return res;
+    }
+
+    const std::string& Query;
+    bool CaseSensitive;
+    std::vector<TNode>& Nodes;
+    std::vector<std::string> Terms;
+
+    size_t Pos = 0;
+    size_t TokenPos = 0;
+    std::string Token;
+    size_t Depth = 0;
+};
+
+TBooleanQuery::TBooleanQuery(const std::string& query, bool caseSensitive): CaseSensitive(caseSensitive)
+{
+    if (query.size() > MAX_QUERY_SIZE) {
+        throw std::runtime_error("Invalid query: maximum size is " + std::to_string(MAX_QUERY_SIZE) + " bytes");
+    }
+    TParser parser(query, caseSensitive, Nodes);
+    Root = parser.Parse();
+    Terms.reset(new TAhoCorasick(parser.GetTerms(), !caseSensitive));
+    AsciiTerms = std::all_of(parser.GetTerms().begin(), parser.GetTerms().end(), [](const std::string& term) {
+        return IsAscii(term.data(), term.size());
+    });
+}
+
+bool TBooleanQuery::Match(const char* msg, size_t size) const
+{
+    // Terms are folded, so a message is folded too if simple ASCII case folding is not enough
+    if (CaseSensitive || IsAscii(msg, size) || (AsciiTerms && !HasAsciiFoldableChars(msg, size))) {
+        return Evaluate(Root, Terms->Find(msg, size));
+    }
+    auto folded = FoldCase(msg, size);
+    return Evaluate(Root, Terms->Find(folded.data(), folded.size()));
+}
+
+bool TBooleanQuery::Evaluate(size_t node, uint64_t hits) const
+{
+    const auto& n = Nodes[node];
+    switch (n.Type) {
+        case TNodeType::Term:
+            return hits & (uint64_t(1) << n.Term);
+        case TNodeType::Not:
+            return !Evaluate(n.Left, hits);
+        case TNodeType::And:
+            return Evaluate(n.Left, hits) && Evaluate(n.Right, hits);
+        case TNodeType::Or:
+            return Evaluate(n.Left, hits) || Evaluate(n.Right, hits);
+    }
+    return false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "aho_corasick.h"
+
+/**
+ * @brief Boolean combination of substrings, e.g. "modbus AND (timeout OR crc) NOT debug".
+ *
+ * Syntax:
+ * - terms are words or strings in double quotes, \" and \\ escapes are allowed in quotes;
+ * - AND, OR and NOT operators are written in upper case, AND may be omitted;
+ * - NOT has the highest priority and OR the lowest one, parentheses change the order.
+ *
+ * All terms are searched in one pass over a message, then the expression is evaluated.
+ */
+class TBooleanQuery
+{
+public:
+    //! Parses the query, throws std::runtime_error on syntax errors
+    TBooleanQuery(const std::string& query, bool caseSensitive);
+
+    //! Checks if a UTF-8 encoded message matches the query
+    bool Match(const char* msg, size_t size) const;
+
+private:
+    enum class TNodeType
+    {
+        Term,
+        Not,
+        And,
+        Or
+    };
+
+    struct TNode
+    {
+        TNodeType Type;
+        //! Operands of operators
+        size_t Left = 0;
+        size_t Right = 0;
+        //! Index of a term in the automaton
+        size_t Term = 0;
+    };
+
+    class TParser;
+
+    bool Evaluate(size_t node, uint64_t hits) const;
+
+    bool CaseSensitive;
+    //! All folded terms are ASCII, so only messages with characters folded to ASCII need Unicode folding
+    bool AsciiTerms = true;
+    std::vector<TNode> Nodes;
+    size_t Root = 0;
+    std::unique_ptr<TAhoCorasick> Terms;
+};
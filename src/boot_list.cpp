@@ -0,0 +1,202 @@
+#include "boot_list.h"
+
+#include "journal_entry.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <systemd/sd-id128.h>
+#include <unistd.h>
+#include <wblib/utils.h>
+
+#define LOG(logger) ::logger.Log() << "[boots] "
+
+namespace
+{
+    const auto BOOT_ID_FIELD = "_BOOT_ID";
+    const uint64_t USEC_IN_SEC = 1000000;
+
+    //! Reads timestamp of the first or the last entry of a boot
+    bool GetBootTimestamp(sd_journal* j, const std::string& bootId, bool first, uint64_t& timestamp)
+    {
+        sd_journal_flush_matches(j);
+        SdThrowError(sd_journal_add_match(j, (std::string(BOOT_ID_FIELD) + "=" + bootId).c_str(), 0),
+                     "Adding match failed");
+        int r = first ? sd_journal_seek_head(j) : sd_journal_seek_tail(j);
+        if (r >= 0) {
+            r = first ? sd_journal_next(j) : sd_journal_previous(j);
+        }
+        uint64_t usec = 0;
+        if (r > 0) {
+            r = sd_journal_get_realtime_usec(j, &usec);
+        }
+        sd_journal_flush_matches(j);
+        if (r < 0) {
+            LOG(Warn) << "Failed to get boot time range: " << strerror(-r);
+            return false;
+        }
+        timestamp = usec / USEC_IN_SEC;
+        return usec != 0;
+    }
+
+    std::set<std::string> GetBootIds(sd_journal* j)
+    {
+        std::set<std::string> res;
+        SdThrowError(sd_journal_query_unique(j, BOOT_ID_FIELD), "Failed to query boot ids");
+        const auto prefixLen = strlen(BOOT_ID_FIELD) + 1; // "_BOOT_ID="
+        const void* data;
+        size_t size;
+        sd_journal_restart_unique(j);
+        while (sd_journal_enumerate_unique(j, &data, &size) > 0) {
+            if (size > prefixLen) {
+                res.emplace(static_cast<const char*>(data) + prefixLen, size - prefixLen);
+            }
+        }
+        return res;
+    }
+}
+
+TBootList::TBootList()
+    : Journal(nullptr),
+      List(Json::arrayValue),
+      Stopped(false),
+      WakeupFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (WakeupFd < 0) {
+        throw std::runtime_error(std::string("Failed to create eventfd: ") + strerror(errno));
+    }
+    sd_id128_t bootId;
+    if (sd_id128_get_boot(&bootId) >= 0) {
+        char bootIdStr[SD_ID128_STRING_MAX];
+        CurrentBootId = sd_id128_to_string(bootId, bootIdStr);
+    }
+
+    int r = sd_journal_open(&Journal, SD_JOURNAL_LOCAL_ONLY);
+    if (r < 0) {
+        LOG(Error) << "Failed to open journal: " << strerror(-r);
+        return;
+    }
+    // Watching must be started before reading, so changes made during the first update are not missed
+    r = sd_journal_get_fd(Journal);
+    if (r < 0) {
+        LOG(Error) << "Failed to watch journal changes: " << strerror(-r);
+    }
+    try {
+        Update();
+    } catch (const std::exception& e) {
+        LOG(Warn) << "Failed to get boots list: " << e.what();
+    }
+    if (r >= 0) {
+        Thread = std::thread([this] { Run(); });
+    }
+}
+
+TBootList::~TBootList()
+{
+    Stopped = true;
+    uint64_t v = 1;
+    if (write(WakeupFd, &v, sizeof(v)) < 0) {
+        LOG(Error) << "Failed to wake up boots watcher: " << strerror(errno);
+    }
+    if (Thread.joinable()) {
+        Thread.join();
+    }
+    if (Journal) {
+        sd_journal_close(Journal);
+    }
+    close(WakeupFd);
+}
+
+Json::Value TBootList::Get()
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    return List;
+}
+
+void TBootList::Run()
+{
+    WBMQTT::SetThreadName("wb-logs boots");
+    int fd = sd_journal_get_fd(Journal);
+    while (!Stopped) {
+        pollfd fds[2] = {{fd, static_cast<short>(sd_journal_get_events(Journal)), 0}, {WakeupFd, POLLIN, 0}};
+        if (poll(fds, 2, GetJournalPollTimeout(Journal)) < 0 && errno != EINTR) {
+            LOG(Error) << "Failed to wait for journal changes: " << strerror(errno);
+            break;
+        }
+        if (Stopped) {
+            break;
+        }
+        int r = sd_journal_process(Journal);
+        if (r < 0) {
+            LOG(Error) << "Failed to process journal changes: " << strerror(-r);
+            break;
+        }
+        // Files are added or removed on rotation and vacuuming, the current boot appears after the first write
+        if (r == SD_JOURNAL_INVALIDATE || (r == SD_JOURNAL_APPEND && !Boots.count(CurrentBootId))) {
+            try {
+                Update();
+            } catch (const std::exception& e) {
+                LOG(Error) << "Failed to update boots list: " << e.what();
+            }
+        }
+    }
+}
+
+void TBootList::Update()
+{
+    auto ids = GetBootIds(Journal);
+    for (auto it = Boots.begin(); it != Boots.end();) {
+        it = ids.count(it->first) ? std::next(it) : Boots.erase(it);
+    }
+
+    // Vacuuming can remove the oldest entries of the oldest remaining boot
+    auto oldest = std::min_element(Boots.begin(), Boots.end(), [](const auto& a, const auto& b) {
+        return a.second.Start < b.second.Start;
+    });
+    if (oldest != Boots.end() && !GetBootTimestamp(Journal, oldest->first, true, oldest->second.Start)) {
+        Boots.erase(oldest);
+    }
+
+    for (const auto& id: ids) {
+        if (Boots.count(id)) {
+            continue;
+        }
+        TBoot boot;
+        if (GetBootTimestamp(Journal, id, true, boot.Start) && GetBootTimestamp(Journal, id, false, boot.End)) {
+            Boots[id] = boot;
+        }
+    }
+
+    auto list = MakeList();
+    std::unique_lock<std::mutex> lk(Mutex);
+    List.swap(list);
+}
+
+Json::Value TBootList::MakeList() const
+{
+    std::vector<std::map<std::string, TBoot>::const_iterator> boots;
+    for (auto it = Boots.cbegin(); it != Boots.cend(); ++it) {
+        boots.push_back(it);
+    }
+    std::sort(boots.begin(), boots.end(), [](const auto& a, const auto& b) {
+        return a->second.Start > b->second.Start;
+    });
+
+    Json::Value res(Json::arrayValue);
+    for (const auto& boot: boots) {
+        Json::Value item;
+        item["hash"] = boot->first;
+        item["start"] = Json::Value::UInt64(boot->second.Start);
+        if (boot->first != CurrentBootId) {
+            item["end"] = Json::Value::UInt64(boot->second.End);
+        }
+        res.append(item);
+    }
+    return res;
+}
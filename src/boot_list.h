@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <systemd/sd-journal.h>
+#include <wblib/json_utils.h>
+
+/**
+ * @brief List of boots stored in the journal.
+ *
+ * Boot ids are enumerated with sd_journal_query_unique(). Time ranges of boots are cached,
+ * the watcher thread updates the list on journal files rotation and removal,
+ * only new and removed boots are looked up.
+ */
+class TBootList
+{
+public:
+    TBootList();
+    ~TBootList();
+
+    TBootList(const TBootList&) = delete;
+    TBootList& operator=(const TBootList&) = delete;
+
+    //! Returns boots ordered from the newest to the oldest
+    Json::Value Get();
+
+private:
+    struct TBoot
+    {
+        //! Timestamps of the first and the last entries of the boot in seconds
+        uint64_t Start = 0;
+        uint64_t End = 0;
+    };
+
+    void Run();
+    void Update();
+    Json::Value MakeList() const;
+
+    sd_journal* Journal;
+    std::string CurrentBootId;
+    std::map<std::string, TBoot> Boots;
+
+    std::mutex Mutex;
+    Json::Value List;
+
+    std::atomic_bool Stopped;
+    int WakeupFd;
+    std::thread Thread;
+};
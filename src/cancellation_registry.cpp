@@ -0,0 +1,24 @@
+#include "cancellation_registry.h"
+
+PCancellationToken TCancellationRegistry::Add(const std::string& requestId)
+{
+    auto token = std::make_shared<std::atomic_bool>(false);
+    std::unique_lock<std::mutex> lk(Mutex);
+    for (auto it = Tokens.begin(); it != Tokens.end();) {
+        it = it->second.expired() ? Tokens.erase(it) : std::next(it);
+    }
+    Tokens.emplace(requestId, token);
+    return token;
+}
+
+void TCancellationRegistry::Cancel(const std::string& requestId)
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    auto range = requestId.empty() ? std::make_pair(Tokens.begin(), Tokens.end()) : Tokens.equal_range(requestId);
+    for (auto it = range.first; it != range.second; ++it) {
+        auto token = it->second.lock();
+        if (token) {
+            *token = true;
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+//! Flag checked by a running request, set to true when the request is cancelled
+typedef std::shared_ptr<std::atomic_bool> PCancellationToken;
+
+//! Cancellation tokens of queued and running requests. A token is forgotten when the request releases it
+class TCancellationRegistry
+{
+public:
+    //! Creates a token for a request with the id. Requests without id can be cancelled only all together
+    PCancellationToken Add(const std::string& requestId);
+
+    //! Cancels requests with the id, all requests if the id is empty
+    void Cancel(const std::string& requestId);
+
+private:
+    std::mutex Mutex;
+    std::multimap<std::string, std::weak_ptr<std::atomic_bool>> Tokens;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+//! Returns value of a hexadecimal digit or -1 if c is not a hexadecimal digit
+inline int GetHexDigitValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
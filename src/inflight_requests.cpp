@@ -0,0 +1,57 @@
+#include "inflight_requests.h"
+
+#include <algorithm>
+
+TInFlightRequests::PRequest TInFlightRequests::Add(const std::string& key,
+                                                   PCancellationToken token,
+                                                   WBMQTT::TMqttRpcServer::TResultCallback onResult,
+                                                   WBMQTT::TMqttRpcServer::TErrorCallback onError)
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    if (!key.empty()) {
+        // A cancelled request returns partial results, so new clients don't join it
+        auto it = std::find_if(Requests.begin(), Requests.end(), [&key](const PRequest& r) {
+            return r->Key == key && !r->Cancelled;
+        });
+        if (it != Requests.end()) {
+            (*it)->Clients.push_back({token, onResult, onError});
+            return nullptr;
+        }
+    }
+    auto request = std::make_shared<TRequest>();
+    request->Key = key;
+    request->Clients.push_back({token, onResult, onError});
+    Requests.push_back(request);
+    return request;
+}
+
+std::vector<TInFlightRequests::TRequest::TClient> TInFlightRequests::Remove(const PRequest& request)
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    Requests.erase(std::remove(Requests.begin(), Requests.end(), request), Requests.end());
+    return std::move(request->Clients);
+}
+
+void TInFlightRequests::Complete(const PRequest& request, const Json::Value& result)
+{
+    for (const auto& client: Remove(request)) {
+        client.OnResult(result);
+    }
+}
+
+void TInFlightRequests::Fail(const PRequest& request, int code, const std::string& message)
+{
+    for (const auto& client: Remove(request)) {
+        client.OnError(code, message);
+    }
+}
+
+void TInFlightRequests::UpdateCancellation()
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    for (auto& request: Requests) {
+        request->Cancelled = std::all_of(request->Clients.begin(),
+                                         request->Clients.end(),
+                                         [](const TRequest::TClient& c) { return c.Token->load(); });
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <wblib/rpc.h>
+
+#include "cancellation_registry.h"
+
+/**
+ * @brief Queued and running requests.
+ *
+ * Requests with equal keys are executed once, clients sending the same request
+ * while it is in flight get the same result. A shared request is cancelled
+ * only if all its clients cancel it.
+ */
+class TInFlightRequests
+{
+public:
+    //! Request executed for one or more clients
+    class TRequest
+    {
+    public:
+        //! Set when all clients of the request are cancelled
+        std::atomic_bool Cancelled{false};
+
+    private:
+        friend class TInFlightRequests;
+
+        struct TClient
+        {
+            PCancellationToken Token;
+            WBMQTT::TMqttRpcServer::TResultCallback OnResult;
+            WBMQTT::TMqttRpcServer::TErrorCallback OnError;
+        };
+
+        std::string Key;
+        std::vector<TClient> Clients;
+    };
+
+    typedef std::shared_ptr<TRequest> PRequest;
+
+    /**
+     * @brief Adds a client to an in-flight request with the key
+     *
+     * @param key request key, requests with empty keys are never shared
+     * @return a new request to execute or nullptr if the client is attached to an existing one
+     */
+    PRequest Add(const std::string& key,
+                 PCancellationToken token,
+                 WBMQTT::TMqttRpcServer::TResultCallback onResult,
+                 WBMQTT::TMqttRpcServer::TErrorCallback onError);
+
+    //! Removes the request and sends its result to all clients
+    void Complete(const PRequest& request, const Json::Value& result);
+
+    //! Removes the request and sends the error to all clients
+    void Fail(const PRequest& request, int code, const std::string& message);
+
+    //! Cancels requests all clients of which are cancelled
+    void UpdateCancellation();
+
+private:
+    std::vector<TRequest::TClient> Remove(const PRequest& request);
+
+    std::mutex Mutex;
+    std::vector<PRequest> Requests;
+};
@@ -0,0 +1,317 @@
+#include "journal_entry.h"
+
+#include "hex_digit.h"
+#include "poll_timeout.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <syslog.h>
+#include <vector>
+
+using namespace WBMQTT;
+
+namespace
+{
+    // libwbmqtt1 log prefixes to syslog severity levels map
+    const std::vector<std::pair<std::string, int>> LibWbMqttLogLevels = {{"ERROR:", LOG_ERR},
+                                                                         {"WARNING:", LOG_WARNING},
+                                                                         {"DEBUG:", LOG_DEBUG}};
+
+    const char BASE64_URL_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    // 128-bit sequence number id, 64-bit sequence number and 64-bit realtime timestamp.
+    // Cursors made before the timestamp was added are accepted too
+    const size_t SEQNUM_ID_BYTES = 16;
+    const size_t COMPACT_CURSOR_BYTES = SEQNUM_ID_BYTES + 8 + 8;
+    const size_t OLD_COMPACT_CURSOR_BYTES = SEQNUM_ID_BYTES + 8;
+    const size_t SEQNUM_ID_HEX_LENGTH = SEQNUM_ID_BYTES * 2;
+
+    //! Returns length of URL-safe base64 encoded data without padding
+    size_t GetBase64Length(size_t bytes)
+    {
+        return (bytes * 4 + 2) / 3;
+    }
+
+    //! URL-safe base64 encoding without padding
+    std::string EncodeBase64Url(const uint8_t* bytes, size_t size)
+    {
+        std::string res;
+        res.reserve(GetBase64Length(size));
+        for (size_t i = 0; i < size; i += 3) {
+            uint32_t v = bytes[i] << 16;
+            if (i + 1 < size) {
+                v |= bytes[i + 1] << 8;
+            }
+            if (i + 2 < size) {
+                v |= bytes[i + 2];
+            }
+            res += BASE64_URL_ALPHABET[(v >> 18) & 0x3F];
+            res += BASE64_URL_ALPHABET[(v >> 12) & 0x3F];
+            if (i + 1 < size) {
+                res += BASE64_URL_ALPHABET[(v >> 6) & 0x3F];
+            }
+            if (i + 2 < size) {
+                res += BASE64_URL_ALPHABET[v & 0x3F];
+            }
+        }
+        return res;
+    }
+
+    //! Decodes URL-safe base64 without padding. Returns false if str has invalid characters
+    bool DecodeBase64Url(const std::string& str, std::vector<uint8_t>& bytes)
+    {
+        bytes.clear();
+        uint32_t v = 0;
+        size_t bits = 0;
+        for (auto c: str) {
+            auto p = strchr(BASE64_URL_ALPHABET, c);
+            if (p == nullptr || *p == '\0') {
+                return false;
+            }
+            v = (v << 6) | (p - BASE64_URL_ALPHABET);
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                bytes.push_back((v >> bits) & 0xFF);
+            }
+        }
+        return true;
+    }
+
+    void AppendUint64(std::vector<uint8_t>& bytes, uint64_t value)
+    {
+        for (size_t i = 0; i < 8; ++i) {
+            bytes.push_back((value >> ((7 - i) * 8)) & 0xFF);
+        }
+    }
+
+    uint64_t ReadUint64(const uint8_t* bytes)
+    {
+        uint64_t res = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            res = (res << 8) | bytes[i];
+        }
+        return res;
+    }
+
+    //! Returns value of a field of a full journal cursor, e.g. "s=...;i=...;b=..."
+    std::string GetCursorField(const std::string& cursor, char name)
+    {
+        for (const auto& field: StringSplit(cursor, ';')) {
+            if (field.size() > 2 && field[0] == name && field[1] == '=') {
+                return field.substr(2);
+            }
+        }
+        return std::string();
+    }
+
+    bool ParseHexCursorField(const std::string& cursor, char name, uint64_t& value)
+    {
+        auto field = GetCursorField(cursor, name);
+        if (field.empty()) {
+            return false;
+        }
+        char* end = nullptr;
+        errno = 0;
+        value = strtoull(field.c_str(), &end, 16);
+        return (*end == '\0' && errno == 0);
+    }
+
+    template<class T> int Compare(const T& a, const T& b)
+    {
+        return (a < b) ? -1 : (b < a);
+    }
+}
+
+void SdThrowError(int res, const std::string& msg)
+{
+    if (res < 0) {
+        throw std::runtime_error(std::string(msg) + ": " + strerror(-res));
+    }
+}
+
+TJournalField GetData(sd_journal* j, const std::string& fieldName)
+{
+    TJournalField res;
+    const char* d;
+    size_t l;
+    int r = sd_journal_get_data(j, fieldName.c_str(), (const void**)&d, &l);
+    // Skip "FIELD=" prefix
+    if (r == 0 && l > fieldName.size() + 1) {
+        res.Data = d + fieldName.size() + 1;
+        res.Size = l - fieldName.size() - 1;
+    }
+    return res;
+}
+
+bool GetPriority(sd_journal* j, int& level)
+{
+    auto d = GetData(j, "PRIORITY");
+    if (d.Data == nullptr) {
+        return false;
+    }
+    level = atoi(std::string(d.Data, d.Size).c_str());
+    return true;
+}
+
+int GetJournalPollTimeout(sd_journal* j)
+{
+    uint64_t t;
+    if (sd_journal_get_timeout(j, &t) < 0) {
+        return -1;
+    }
+    return GetPollTimeout(t);
+}
+
+std::string GetCursor(sd_journal* j)
+{
+    char* k = nullptr;
+    SdThrowError(sd_journal_get_cursor(j, &k), "Failed to get cursor");
+    std::string res(k);
+    free(k);
+    return res;
+}
+
+bool ParseCursor(const std::string& cursor, TJournalPosition& position)
+{
+    position.SeqnumId = GetCursorField(cursor, 's');
+    position.BootId = GetCursorField(cursor, 'b');
+    return !position.SeqnumId.empty() && !position.BootId.empty() &&
+           ParseHexCursorField(cursor, 'i', position.Seqnum) &&
+           ParseHexCursorField(cursor, 'm', position.Monotonic) &&
+           ParseHexCursorField(cursor, 't', position.Realtime);
+}
+
+int CompareJournalPositions(const TJournalPosition& a, const TJournalPosition& b)
+{
+    // The same rules as in sd-journal compare_entry_order()
+    if (a.SeqnumId == b.SeqnumId) {
+        return Compare(a.Seqnum, b.Seqnum);
+    }
+    if (a.BootId == b.BootId) {
+        auto res = Compare(a.Monotonic, b.Monotonic);
+        if (res != 0) {
+            return res;
+        }
+    }
+    return Compare(a.Realtime, b.Realtime);
+}
+
+std::string MakeCompactCursor(const std::string& cursor)
+{
+    auto seqnumId = GetCursorField(cursor, 's');
+    uint64_t seqnum;
+    uint64_t realtime;
+    if (seqnumId.size() != SEQNUM_ID_HEX_LENGTH || !ParseHexCursorField(cursor, 'i', seqnum) ||
+        !ParseHexCursorField(cursor, 't', realtime))
+    {
+        return cursor;
+    }
+
+    std::vector<uint8_t> bytes;
+    bytes.reserve(COMPACT_CURSOR_BYTES);
+    for (size_t i = 0; i < SEQNUM_ID_HEX_LENGTH; i += 2) {
+        auto high = GetHexDigitValue(seqnumId[i]);
+        auto low = GetHexDigitValue(seqnumId[i + 1]);
+        if (high < 0 || low < 0) {
+            return cursor;
+        }
+        bytes.push_back((high << 4) | low);
+    }
+    AppendUint64(bytes, seqnum);
+    AppendUint64(bytes, realtime);
+    return EncodeBase64Url(bytes.data(), bytes.size());
+}
+
+std::string ExpandCursor(const std::string& cursor)
+{
+    if (cursor.size() != GetBase64Length(COMPACT_CURSOR_BYTES) &&
+        cursor.size() != GetBase64Length(OLD_COMPACT_CURSOR_BYTES))
+    {
+        return cursor;
+    }
+    std::vector<uint8_t> bytes;
+    if (!DecodeBase64Url(cursor, bytes)) {
+        return cursor;
+    }
+
+    // Partial cursor makes sd_journal_seek_cursor() seek by sequence number in files with the same
+    // sequence number id and by the timestamp in other files
+    std::ostringstream res;
+    res << "s=" << std::hex << std::setfill('0');
+    for (size_t i = 0; i < SEQNUM_ID_BYTES; ++i) {
+        res << std::setw(2) << static_cast<int>(bytes[i]);
+    }
+    res << ";i=" << std::setw(0) << ReadUint64(bytes.data() + SEQNUM_ID_BYTES);
+    if (bytes.size() == COMPACT_CURSOR_BYTES) {
+        res << ";t=" << ReadUint64(bytes.data() + SEQNUM_ID_BYTES + 8);
+    }
+    return res.str();
+}
+
+bool AddMsg(sd_journal* j, TLogEntry& entry, TMessageMatcher& matcher)
+{
+    auto d = GetData(j, "MESSAGE");
+    if (d.Data == nullptr) {
+        return false;
+    }
+    if (!matcher.IsEmpty()) {
+        if (!matcher.Match(d.Data, d.Size)) {
+            return false;
+        }
+        entry.Spans = matcher.GetSpans();
+    }
+    entry.Msg.assign(d.Data, d.Size);
+    if (entry.Level == TLogEntry::NO_LEVEL) {
+        std::any_of(LibWbMqttLogLevels.begin(), LibWbMqttLogLevels.end(), [&](const auto& p) {
+            if (StringStartsWith(entry.Msg, p.first)) {
+                entry.Level = p.second;
+                return true;
+            }
+            return false;
+        });
+    }
+    return true;
+}
+
+void AddTimestamp(sd_journal* j, TLogEntry& entry)
+{
+    uint64_t ts;
+    SdThrowError(sd_journal_get_realtime_usec(j, &ts), "Failed to read timestamp");
+    // __REALTIME_TIMESTAMP is in microseconds, convert it to milliseconds
+    entry.Time = ts / 1000;
+}
+
+void AddPriority(sd_journal* j, TLogEntry& entry)
+{
+    int level;
+    if (!GetPriority(j, level)) {
+        return;
+    }
+    // journald sets LOG_INFO priority for all unprefixed messages got fom stderr/stdout
+    // They priority is set in ParseMsg according to a prefix.
+    if (level != LOG_INFO && entry.Level == TLogEntry::NO_LEVEL) {
+        entry.Level = level;
+    }
+}
+
+void AddCursor(sd_journal* j, TLogEntry& entry)
+{
+    entry.Cursor = GetCursor(j);
+}
+
+void AddService(sd_journal* j, TLogEntry& entry)
+{
+    auto d = GetData(j, "_SYSTEMD_UNIT");
+    if (d.Data == nullptr) {
+        return;
+    }
+    entry.Service.assign(d.Data, d.Size);
+    const std::string SERVICE_SUFFIX(".service");
+    if (WBMQTT::StringHasSuffix(entry.Service, SERVICE_SUFFIX)) {
+        entry.Service.resize(entry.Service.length() - SERVICE_SUFFIX.length());
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+
+#include <systemd/sd-journal.h>
+
+#include "log_entry.h"
+#include "message_matcher.h"
+
+// Helpers to fill a log entry sent to clients from current journal entry
+
+//! Throws std::runtime_error if res is a negative sd-journal error code
+void SdThrowError(int res, const std::string& msg);
+
+//! Value of a field of a journal entry, it isn't NUL-terminated
+struct TJournalField
+{
+    const char* Data = nullptr;
+    size_t Size = 0;
+};
+
+/**
+ * @brief Returns value of a field of current journal entry, Data is nullptr if the field is missing or empty.
+ *
+ * The value is valid until the next call for the same journal.
+ */
+TJournalField GetData(sd_journal* j, const std::string& fieldName);
+
+//! Reads PRIORITY field of current journal entry. Returns false if the field is missing
+bool GetPriority(sd_journal* j, int& level);
+
+//! Converts sd_journal_get_timeout() result to poll() timeout
+int GetJournalPollTimeout(sd_journal* j);
+
+//! Returns cursor of current journal entry
+std::string GetCursor(sd_journal* j);
+
+//! Position of an entry in the journal parsed from its full cursor
+struct TJournalPosition
+{
+    std::string SeqnumId;
+    uint64_t Seqnum = 0;
+    std::string BootId;
+    uint64_t Monotonic = 0;
+    uint64_t Realtime = 0;
+};
+
+//! Parses a full journal cursor, e.g. "s=...;i=...;b=...;m=...;t=...;x=...". Returns false if a field is missing
+bool ParseCursor(const std::string& cursor, TJournalPosition& position);
+
+/**
+ * @brief Compares positions of journal entries in the order sd-journal reads entries from several files.
+ *
+ * Entries with the same sequence number id are ordered by sequence number, entries of the same boot
+ * by monotonic time and other entries by realtime, so clock changes don't break the order.
+ * Returns a negative value if a is before b, a positive value if a is after b and 0 if they are equal.
+ */
+int CompareJournalPositions(const TJournalPosition& a, const TJournalPosition& b);
+
+/**
+ * @brief Makes a compact form of a journal cursor.
+ *
+ * The compact cursor is URL-safe base64 encoded sequence number id and sequence number.
+ * Returns the cursor unchanged if it doesn't contain them.
+ */
+std::string MakeCompactCursor(const std::string& cursor);
+
+//! Converts a compact cursor to a cursor accepted by sd_journal_seek_cursor(). Other cursors are returned unchanged
+std::string ExpandCursor(const std::string& cursor);
+
+//! Sets message, match spans and a level deduced from libwbmqtt1 log prefixes. Returns false if the message doesn't match
+bool AddMsg(sd_journal* j, TLogEntry& entry, TMessageMatcher& matcher);
+
+void AddTimestamp(sd_journal* j, TLogEntry& entry);
+void AddPriority(sd_journal* j, TLogEntry& entry);
+void AddCursor(sd_journal* j, TLogEntry& entry);
+void AddService(sd_journal* j, TLogEntry& entry);
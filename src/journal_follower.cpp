@@ -0,0 +1,279 @@
+#include "journal_follower.h"
+
+#include "journal_entry.h"
+#include "log.h"
+#include "request_params.h"
+#include "result_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace WBMQTT;
+
+#define LOG(logger) ::logger.Log() << "[follow] "
+
+namespace
+{
+    const auto FOLLOW_TOPIC_PREFIX = "/wb_logs/follow/";
+    const auto SUBSCRIPTION_TTL = std::chrono::seconds(60);
+    const size_t MAX_SUBSCRIPTIONS = 32;
+    const size_t MAX_ENTRIES_PER_MESSAGE = 100;
+
+    //! Matching of a message is interrupted after the time, so a regex can't block the reader thread
+    const auto MAX_MATCH_DURATION = std::chrono::milliseconds(100);
+
+    std::string GenerateSubscriptionId()
+    {
+        std::random_device rd;
+        std::uniform_int_distribution<uint64_t> dist;
+        std::ostringstream ss;
+        ss << std::hex << std::setfill('0') << std::setw(16) << dist(rd);
+        return ss.str();
+    }
+}
+
+TJournalFollower::TJournalFollower(PMqttClient mqttClient, TRegexCache& regexCache)
+    : MqttClient(mqttClient),
+      RegexCache(regexCache),
+      Stopped(false),
+      Failed(false),
+      WakeupFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (WakeupFd < 0) {
+        throw std::runtime_error(std::string("Failed to create eventfd: ") + strerror(errno));
+    }
+    Thread = std::thread([this] { Run(); });
+}
+
+TJournalFollower::~TJournalFollower()
+{
+    Stopped = true;
+    Wakeup();
+    if (Thread.joinable()) {
+        Thread.join();
+    }
+    close(WakeupFd);
+}
+
+Json::Value TJournalFollower::Follow(const Json::Value& params)
+{
+    auto id = params.get("id", "").asString();
+    if (id.empty()) {
+        id = GenerateSubscriptionId();
+    } else if (!IsValidTopicId(id)) {
+        throw std::runtime_error("Invalid subscription id '" + id + "'");
+    }
+
+    std::unique_ptr<TSubscription> subscription(new TSubscription);
+    subscription->Topic = FOLLOW_TOPIC_PREFIX + id;
+    subscription->Service = params.get("service", "").asString();
+    subscription->Levels = GetLevels(params);
+    subscription->Matcher = MakeMatcher(params, RegexCache);
+    subscription->ExpirationTime = std::chrono::steady_clock::now() + SUBSCRIPTION_TTL;
+
+    Json::Value res;
+    res["id"] = id;
+    res["topic"] = subscription->Topic;
+    res["ttl"] = Json::Value::Int64(std::chrono::duration_cast<std::chrono::seconds>(SUBSCRIPTION_TTL).count());
+    {
+        std::unique_lock<std::mutex> lk(Mutex);
+        if (Failed) {
+            throw std::runtime_error("Journal reader is stopped by an error");
+        }
+        if (!Subscriptions.count(id) && Subscriptions.size() >= MAX_SUBSCRIPTIONS) {
+            throw std::runtime_error("Too many subscriptions");
+        }
+        Subscriptions[id] = std::move(subscription);
+    }
+    // The reader thread recalculates subscriptions expiration timeout
+    Wakeup();
+    return res;
+}
+
+void TJournalFollower::Unfollow(const std::string& id)
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    Subscriptions.erase(id);
+}
+
+void TJournalFollower::Wakeup()
+{
+    uint64_t v = 1;
+    if (write(WakeupFd, &v, sizeof(v)) < 0 && errno != EAGAIN) {
+        LOG(Error) << "Failed to wake up journal reader: " << strerror(errno);
+    }
+}
+
+void TJournalFollower::Run()
+{
+    SetThreadName("wb-logs follow");
+    ReadJournal();
+    // The reader exits before stop only on errors, so subscribers will never get new entries
+    if (!Stopped) {
+        std::unique_lock<std::mutex> lk(Mutex);
+        Failed = true;
+        Subscriptions.clear();
+    }
+}
+
+void TJournalFollower::ReadJournal()
+{
+    sd_journal* j = nullptr;
+    int r = sd_journal_open(&j, SD_JOURNAL_LOCAL_ONLY);
+    if (r < 0) {
+        LOG(Error) << "Failed to open journal: " << strerror(-r);
+        return;
+    }
+    std::unique_ptr<sd_journal, decltype(&sd_journal_close)> journalPtr(j, &sd_journal_close);
+
+    int fd = sd_journal_get_fd(j);
+    if (fd < 0) {
+        LOG(Error) << "Failed to watch journal changes: " << strerror(-fd);
+        return;
+    }
+
+    // Park at the last entry, so sd_journal_next() returns only new ones
+    if (sd_journal_seek_tail(j) >= 0) {
+        sd_journal_previous(j);
+    }
+
+    while (!Stopped) {
+        int timeout = GetJournalPollTimeout(j);
+        int expirationTimeout = RemoveExpiredSubscriptions();
+        if (timeout < 0 || (expirationTimeout >= 0 && expirationTimeout < timeout)) {
+            timeout = expirationTimeout;
+        }
+
+        pollfd fds[2] = {{fd, static_cast<short>(sd_journal_get_events(j)), 0}, {WakeupFd, POLLIN, 0}};
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+            LOG(Error) << "Failed to wait for journal changes: " << strerror(errno);
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t v;
+            if (read(WakeupFd, &v, sizeof(v)) < 0) {
+                LOG(Debug) << "Failed to read eventfd: " << strerror(errno);
+            }
+        }
+
+        r = sd_journal_process(j);
+        if (r < 0) {
+            LOG(Error) << "Failed to process journal changes: " << strerror(-r);
+            break;
+        }
+        try {
+            ReadNewEntries(j);
+        } catch (const std::exception& e) {
+            LOG(Error) << e.what();
+        }
+    }
+}
+
+void TJournalFollower::ReadNewEntries(sd_journal* j)
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    int r;
+    while ((r = sd_journal_next(j)) > 0) {
+        if (Subscriptions.empty()) {
+            continue;
+        }
+        auto unit = GetData(j, "_SYSTEMD_UNIT");
+        std::string service(unit.Data ? unit.Data : "", unit.Size);
+        int priority;
+        if (!GetPriority(j, priority)) {
+            priority = -1;
+        }
+        for (auto& subscription: Subscriptions) {
+            AddEntry(j, *subscription.second, service, priority);
+        }
+    }
+    if (r < 0) {
+        LOG(Error) << "Failed to get next journal entry: " << strerror(-r);
+    }
+    for (auto& subscription: Subscriptions) {
+        Publish(*subscription.second);
+    }
+}
+
+void TJournalFollower::AddEntry(sd_journal* j,
+                                TSubscription& subscription,
+                                const std::string& service,
+                                int priority)
+{
+    if (!subscription.Service.empty() && subscription.Service != service) {
+        return;
+    }
+    if (!subscription.Levels.empty() && !subscription.Levels.count(priority)) {
+        return;
+    }
+    TLogEntry item;
+    subscription.Matcher.SetDeadline(std::chrono::steady_clock::now() + MAX_MATCH_DURATION, &Stopped);
+    if (!AddMsg(j, item, subscription.Matcher)) {
+        if (subscription.Matcher.IsInterrupted()) {
+            LOG(Warn) << "Matching of a message is too long, it is not sent to " << subscription.Topic;
+        }
+        return;
+    }
+    AddTimestamp(j, item);
+    AddPriority(j, item);
+    if (subscription.Service.empty()) {
+        AddService(j, item);
+    }
+    // cursor is needed only for the first and the last record
+    if (subscription.Entries.size() > 1) {
+        subscription.Entries.back().Cursor.clear();
+    }
+    AddCursor(j, item);
+    subscription.Entries.push_back(std::move(item));
+    if (subscription.Entries.size() >= MAX_ENTRIES_PER_MESSAGE) {
+        Publish(subscription);
+    }
+}
+
+void TJournalFollower::Publish(TSubscription& subscription)
+{
+    auto& entries = subscription.Entries;
+    if (entries.empty()) {
+        return;
+    }
+    // Send entries in the same order as Load does
+    std::string payload("[");
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        if (it != entries.rbegin()) {
+            payload += ',';
+        }
+        AppendJson(payload, *it);
+    }
+    payload += ']';
+    MqttClient->Publish(TMqttMessage(subscription.Topic, payload, 1, false));
+    entries.clear();
+}
+
+int TJournalFollower::RemoveExpiredSubscriptions()
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    auto now = std::chrono::steady_clock::now();
+    int timeout = -1;
+    for (auto it = Subscriptions.begin(); it != Subscriptions.end();) {
+        if (it->second->ExpirationTime <= now) {
+            LOG(Debug) << "Subscription " << it->first << " is expired";
+            it = Subscriptions.erase(it);
+            continue;
+        }
+        int left =
+            std::chrono::duration_cast<std::chrono::milliseconds>(it->second->ExpirationTime - now).count() + 1;
+        if (timeout < 0 || left < timeout) {
+            timeout = left;
+        }
+        ++it;
+    }
+    return timeout;
+}
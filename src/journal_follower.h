@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <systemd/sd-journal.h>
+#include <wblib/mqtt.h>
+
+#include "log_entry.h"
+#include "message_matcher.h"
+
+/**
+ * @brief Publishes new journal entries to MQTT topics of subscribed clients.
+ *
+ * A single journal handle is parked at the tail of the journal, the reader thread wakes up
+ * on journal changes, filters new entries according to every subscription and publishes matched ones.
+ * Subscriptions expire if they are not renewed by clients.
+ */
+class TJournalFollower
+{
+public:
+    TJournalFollower(WBMQTT::PMqttClient mqttClient, TRegexCache& regexCache);
+    ~TJournalFollower();
+
+    TJournalFollower(const TJournalFollower&) = delete;
+    TJournalFollower& operator=(const TJournalFollower&) = delete;
+
+    //! Creates a new subscription or renews an existing one. Returns subscription id and topic
+    Json::Value Follow(const Json::Value& params);
+
+    void Unfollow(const std::string& id);
+
+private:
+    struct TSubscription
+    {
+        std::string Topic;
+        std::string Service;
+        std::set<int> Levels;
+        TMessageMatcher Matcher;
+        std::chrono::steady_clock::time_point ExpirationTime;
+        std::vector<TLogEntry> Entries;
+    };
+
+    void Run();
+    //! Reads the journal until the follower is stopped or an error occurs
+    void ReadJournal();
+    void ReadNewEntries(sd_journal* j);
+    //! service is empty and priority is -1 if the entry doesn't have the field
+    void AddEntry(sd_journal* j, TSubscription& subscription, const std::string& service, int priority);
+    void Publish(TSubscription& subscription);
+    int RemoveExpiredSubscriptions();
+    void Wakeup();
+
+    WBMQTT::PMqttClient MqttClient;
+    TRegexCache& RegexCache;
+    std::mutex Mutex;
+    std::map<std::string, std::unique_ptr<TSubscription>> Subscriptions;
+    std::atomic_bool Stopped;
+    //! The reader thread is stopped by an error, protected by Mutex
+    bool Failed;
+    int WakeupFd;
+    std::thread Thread;
+};
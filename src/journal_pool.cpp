@@ -0,0 +1,147 @@
+#include "journal_pool.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <systemd/sd-id128.h>
+#include <wblib/utils.h>
+
+#define LOG(logger) ::logger.Log() << "[journal pool] "
+
+namespace
+{
+    const std::vector<std::string> JOURNAL_DIRS = {"/var/log/journal/", "/run/log/journal/"};
+
+    //! Returns sorted list of the local machine journal files, the same files are opened by sd_journal_open()
+    std::vector<std::string> GetJournalFiles()
+    {
+        std::vector<std::string> res;
+        sd_id128_t machineId;
+        if (sd_id128_get_machine(&machineId) < 0) {
+            return res;
+        }
+        char machineIdStr[SD_ID128_STRING_MAX];
+        sd_id128_to_string(machineId, machineIdStr);
+        for (const auto& dir: JOURNAL_DIRS) {
+            auto path = dir + machineIdStr + "/";
+            auto dirCloser = [](DIR* d) { closedir(d); };
+            std::unique_ptr<DIR, decltype(dirCloser)> d(opendir(path.c_str()), dirCloser);
+            if (!d) {
+                continue;
+            }
+            while (auto de = readdir(d.get())) {
+                std::string name(de->d_name);
+                if (WBMQTT::StringHasSuffix(name, ".journal") || WBMQTT::StringHasSuffix(name, ".journal~")) {
+                    res.push_back(path + name);
+                }
+            }
+        }
+        std::sort(res.begin(), res.end());
+        return res;
+    }
+}
+
+TJournalPool::TJournalPool(size_t maxIdleHandles, const std::vector<std::string>& files)
+    : MaxIdleHandles(maxIdleHandles),
+      Files(files)
+{}
+
+TJournalPool::~TJournalPool()
+{
+    for (auto j: IdleHandles) {
+        sd_journal_close(j);
+    }
+}
+
+TJournalPool::PJournal TJournalPool::Acquire()
+{
+    sd_journal* j = nullptr;
+    {
+        std::unique_lock<std::mutex> lk(Mutex);
+        if (!IdleHandles.empty()) {
+            j = IdleHandles.back();
+            IdleHandles.pop_back();
+        }
+    }
+    if (j != nullptr) {
+        // Pick up new, rotated and removed journal files
+        int r = sd_journal_process(j);
+        if (r < 0) {
+            LOG(Warn) << "Failed to process journal changes, reopening: " << strerror(-r);
+            sd_journal_close(j);
+            j = nullptr;
+        }
+    }
+    if (j == nullptr) {
+        j = Open();
+    }
+    return PJournal(j, [this](sd_journal* j) { Release(j); });
+}
+
+sd_journal* TJournalPool::Open()
+{
+    sd_journal* j = nullptr;
+    int r;
+    if (Files.empty()) {
+        r = sd_journal_open(&j, SD_JOURNAL_LOCAL_ONLY);
+    } else {
+        std::vector<const char*> paths;
+        for (const auto& file: Files) {
+            paths.push_back(file.c_str());
+        }
+        paths.push_back(nullptr);
+        r = sd_journal_open_files(&j, paths.data(), 0);
+    }
+    if (r < 0) {
+        throw std::runtime_error(std::string("Failed to open journal: ") + strerror(-r));
+    }
+    // sd_journal_process() tracks journal files changes only after inotify is set up by sd_journal_get_fd()
+    r = sd_journal_get_fd(j);
+    if (r < 0) {
+        LOG(Warn) << "Failed to watch journal changes: " << strerror(-r);
+    }
+    return j;
+}
+
+void TJournalPool::Release(sd_journal* j)
+{
+    sd_journal_flush_matches(j);
+    {
+        std::unique_lock<std::mutex> lk(Mutex);
+        if (IdleHandles.size() < MaxIdleHandles) {
+            IdleHandles.push_back(j);
+            return;
+        }
+    }
+    sd_journal_close(j);
+}
+
+TJournalPartitions::TJournalPartitions(size_t maxIdleHandles): MaxIdleHandles(maxIdleHandles)
+{}
+
+std::vector<PJournalPool> TJournalPartitions::Get(size_t maxPartitions)
+{
+    auto files = GetJournalFiles();
+    auto partitionsCount = std::min(maxPartitions, files.size());
+    if (partitionsCount == 0) {
+        return {};
+    }
+    std::unique_lock<std::mutex> lk(Mutex);
+    if (files != Files || partitionsCount != Partitions.size()) {
+        // Round-robin distribution gives every partition a part of every time range
+        std::vector<std::vector<std::string>> partitionFiles(partitionsCount);
+        for (size_t i = 0; i < files.size(); ++i) {
+            partitionFiles[i % partitionsCount].push_back(files[i]);
+        }
+        Partitions.clear();
+        for (const auto& f: partitionFiles) {
+            Partitions.push_back(std::make_shared<TJournalPool>(MaxIdleHandles, f));
+        }
+        Files.swap(files);
+    }
+    return Partitions;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <systemd/sd-journal.h>
+
+//! Pool of opened journal handles.
+//! Opening a journal enumerates and maps all journal files, so handles are kept open between requests.
+//! Matches are flushed when a handle returns to the pool, journal files rotation and vacuuming
+//! are applied with sd_journal_process() before the handle is given out again.
+class TJournalPool
+{
+public:
+    typedef std::unique_ptr<sd_journal, std::function<void(sd_journal*)>> PJournal;
+
+    /**
+     * @brief Creates a pool of journal handles
+     *
+     * @param maxIdleHandles maximum number of opened handles not used by anybody
+     * @param files journal files to open, all local journal files are opened if empty
+     */
+    explicit TJournalPool(size_t maxIdleHandles, const std::vector<std::string>& files = {});
+    ~TJournalPool();
+
+    TJournalPool(const TJournalPool&) = delete;
+    TJournalPool& operator=(const TJournalPool&) = delete;
+
+    PJournal Acquire();
+
+private:
+    sd_journal* Open();
+    void Release(sd_journal* j);
+
+    std::mutex Mutex;
+    std::vector<sd_journal*> IdleHandles;
+    size_t MaxIdleHandles;
+    std::vector<std::string> Files;
+};
+
+typedef std::shared_ptr<TJournalPool> PJournalPool;
+
+//! Splits local journal files into partitions for concurrent scanning, every partition has its own handles pool.
+//! Partitions are rebuilt when journal files are rotated or removed.
+class TJournalPartitions
+{
+public:
+    //! @param maxIdleHandles maximum number of opened handles not used by anybody in every partition pool
+    explicit TJournalPartitions(size_t maxIdleHandles);
+
+    //! Returns pools of handles for up to maxPartitions partitions
+    std::vector<PJournalPool> Get(size_t maxPartitions);
+
+private:
+    size_t MaxIdleHandles;
+    std::mutex Mutex;
+    std::vector<std::string> Files;
+    std::vector<PJournalPool> Partitions;
+};
@@ -0,0 +1,121 @@
+#include "kmsg_reader.h"
+
+#include "hex_digit.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define LOG(logger) ::logger.Log() << "[kmsg] "
+
+namespace
+{
+    const auto KMSG_PATH = "/dev/kmsg";
+
+    //! Parses decimal number up to a delimiter, returns pointer to the delimiter or nullptr
+    const char* ParseNumber(const char* p, const char* end, char delimiter, uint64_t& value)
+    {
+        value = 0;
+        auto start = p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p - '0');
+            ++p;
+        }
+        return (p != start && p < end && *p == delimiter) ? p : nullptr;
+    }
+
+    /**
+     * @brief Parses /dev/kmsg record.
+     *
+     * Record format: "<facility and level>,<seqnum>,<timestamp>,<flags>[,...];<message>\n[ KEY=value\n...]"
+     */
+    bool ParseRecord(const char* data, size_t size, TKmsgRecord& record)
+    {
+        auto end = data + size;
+        uint64_t prefix;
+        auto p = ParseNumber(data, end, ',', prefix);
+        if (p == nullptr) {
+            return false;
+        }
+        p = ParseNumber(p + 1, end, ',', record.Seqnum);
+        if (p == nullptr) {
+            return false;
+        }
+        p = ParseNumber(p + 1, end, ',', record.Timestamp);
+        if (p == nullptr) {
+            return false;
+        }
+        p = static_cast<const char*>(memchr(p, ';', end - p));
+        if (p == nullptr) {
+            return false;
+        }
+        ++p;
+        auto msgEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        record.Level = prefix & 7;
+        record.Msg = p;
+        record.MsgSize = (msgEnd ? msgEnd : end) - p;
+        return true;
+    }
+}
+
+TKmsgReader::TKmsgReader(): Fd(open(KMSG_PATH, O_RDONLY | O_NONBLOCK | O_CLOEXEC))
+{
+    if (Fd < 0) {
+        throw std::runtime_error(std::string("Failed to open ") + KMSG_PATH + ": " + strerror(errno));
+    }
+    // The same position as "dmesg" uses, it respects ring buffer clearing by "dmesg -c"
+    if (lseek(Fd, 0, SEEK_DATA) < 0) {
+        LOG(Warn) << "Failed to seek " << KMSG_PATH << ": " << strerror(errno);
+    }
+}
+
+TKmsgReader::~TKmsgReader()
+{
+    close(Fd);
+}
+
+bool TKmsgReader::Next(TKmsgRecord& record)
+{
+    while (true) {
+        auto size = read(Fd, Buffer, sizeof(Buffer));
+        if (size < 0) {
+            // The record was overwritten while reading, the next read returns the oldest available one
+            if (errno == EPIPE || errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                LOG(Error) << "Failed to read " << KMSG_PATH << ": " << strerror(errno);
+            }
+            return false;
+        }
+        if (size == 0) {
+            return false;
+        }
+        if (ParseRecord(Buffer, size, record)) {
+            return true;
+        }
+        LOG(Warn) << "Failed to parse kernel log record";
+    }
+}
+
+void UnescapeKmsg(const char* msg, size_t size, std::string& out)
+{
+    out.clear();
+    out.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        if (msg[i] == '\\' && i + 3 < size && msg[i + 1] == 'x') {
+            auto hi = GetHexDigitValue(msg[i + 2]);
+            auto lo = GetHexDigitValue(msg[i + 3]);
+            if (hi >= 0 && lo >= 0) {
+                out += static_cast<char>((hi << 4) | lo);
+                i += 3;
+                continue;
+            }
+        }
+        out += msg[i];
+    }
+}
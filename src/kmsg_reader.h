@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//! Kernel log record. Message points to the reader buffer and is valid until the next read
+struct TKmsgRecord
+{
+    //! syslog severity level
+    int Level;
+
+    //! Kernel sequence number of the record
+    uint64_t Seqnum;
+
+    //! Time since boot in microseconds
+    uint64_t Timestamp;
+
+    //! Message text with non-printable characters escaped as \xHH
+    const char* Msg;
+    size_t MsgSize;
+};
+
+//! Reads kernel ring buffer records from /dev/kmsg starting from the oldest available one
+class TKmsgReader
+{
+public:
+    TKmsgReader();
+    ~TKmsgReader();
+
+    TKmsgReader(const TKmsgReader&) = delete;
+    TKmsgReader& operator=(const TKmsgReader&) = delete;
+
+    //! Reads the next record, returns false if there are no more records
+    bool Next(TKmsgRecord& record);
+
+private:
+    int Fd;
+
+    // Maximum record size is limited by kernel CONSOLE_EXT_LOG_MAX
+    char Buffer[8192];
+};
+
+//! Decodes \xHH escape sequences of a kernel log message
+void UnescapeKmsg(const char* msg, size_t size, std::string& out);
@@ -0,0 +1,224 @@
+#include "log_entry.h"
+
+namespace
+{
+    const char HEX_DIGITS[] = "0123456789abcdef";
+    const char REPLACEMENT_CHARACTER[] = "\xef\xbf\xbd";
+
+    //! Returns length of a valid UTF-8 sequence starting at str or 0 if the sequence is invalid
+    size_t GetUtf8SequenceLength(const unsigned char* str, size_t size)
+    {
+        auto isContinuation = [](unsigned char c) { return (c & 0xC0) == 0x80; };
+        auto c = str[0];
+        if (c >= 0xC2 && c <= 0xDF) {
+            return (size >= 2 && isContinuation(str[1])) ? 2 : 0;
+        }
+        if (c >= 0xE0 && c <= 0xEF) {
+            if (size < 3 || !isContinuation(str[1]) || !isContinuation(str[2])) {
+                return 0;
+            }
+            // overlong encodings and surrogates
+            if ((c == 0xE0 && str[1] < 0xA0) || (c == 0xED && str[1] > 0x9F)) {
+                return 0;
+            }
+            return 3;
+        }
+        if (c >= 0xF0 && c <= 0xF4) {
+            if (size < 4 || !isContinuation(str[1]) || !isContinuation(str[2]) || !isContinuation(str[3])) {
+                return 0;
+            }
+            // overlong encodings and code points above U+10FFFF
+            if ((c == 0xF0 && str[1] < 0x90) || (c == 0xF4 && str[1] > 0x8F)) {
+                return 0;
+            }
+            return 4;
+        }
+        return 0;
+    }
+
+    //! Replaces every invalid UTF-8 byte by U+FFFD the same way as AppendJsonString(),
+    //! so jsoncpp doesn't handle invalid sequences in its own way
+    std::string ToValidUtf8(const std::string& str)
+    {
+        auto s = reinterpret_cast<const unsigned char*>(str.data());
+        std::string res;
+        size_t copied = 0;
+        size_t i = 0;
+        while (i < str.size()) {
+            if (s[i] < 0x80) {
+                ++i;
+                continue;
+            }
+            auto len = GetUtf8SequenceLength(s + i, str.size() - i);
+            if (len) {
+                i += len;
+                continue;
+            }
+            res.append(str, copied, i - copied);
+            res += REPLACEMENT_CHARACTER;
+            copied = ++i;
+        }
+        if (copied == 0) {
+            return str;
+        }
+        res.append(str, copied, std::string::npos);
+        return res;
+    }
+}
+
+Json::Value ToJson(const TLogEntry& entry)
+{
+    Json::Value res;
+    res["msg"] = ToValidUtf8(entry.Msg);
+    if (entry.Time) {
+        res["time"] = Json::Value::UInt64(entry.Time);
+    }
+    if (entry.Level != TLogEntry::NO_LEVEL) {
+        res["level"] = entry.Level;
+    }
+    if (!entry.Service.empty()) {
+        res["service"] = ToValidUtf8(entry.Service);
+    }
+    if (!entry.Cursor.empty()) {
+        res["cursor"] = entry.Cursor;
+    }
+    if (!entry.Spans.empty()) {
+        auto& spans = res["spans"];
+        for (const auto& span: entry.Spans) {
+            Json::Value item(Json::arrayValue);
+            item.append(Json::Value::UInt64(span.Begin));
+            item.append(Json::Value::UInt64(span.End));
+            spans.append(item);
+        }
+    }
+    return res;
+}
+
+void AppendJson(std::string& out, const TLogEntry& entry)
+{
+    out += "{\"msg\":";
+    AppendJsonString(out, entry.Msg.data(), entry.Msg.size());
+    if (entry.Time) {
+        out += ",\"time\":";
+        out += std::to_string(entry.Time);
+    }
+    if (entry.Level != TLogEntry::NO_LEVEL) {
+        out += ",\"level\":";
+        out += std::to_string(entry.Level);
+    }
+    if (!entry.Service.empty()) {
+        out += ",\"service\":";
+        AppendJsonString(out, entry.Service.data(), entry.Service.size());
+    }
+    if (!entry.Cursor.empty()) {
+        out += ",\"cursor\":";
+        AppendJsonString(out, entry.Cursor.data(), entry.Cursor.size());
+    }
+    if (!entry.Spans.empty()) {
+        out += ",\"spans\":[";
+        for (size_t i = 0; i < entry.Spans.size(); ++i) {
+            if (i) {
+                out += ',';
+            }
+            out += '[';
+            out += std::to_string(entry.Spans[i].Begin);
+            out += ',';
+            out += std::to_string(entry.Spans[i].End);
+            out += ']';
+        }
+        out += ']';
+    }
+    out += '}';
+}
+
+void ConvertSpans(const char* msg, size_t size, std::vector<TMatchSpan>& spans, TSpanUnits from, TSpanUnits to)
+{
+    if (from == to) {
+        return;
+    }
+    auto s = reinterpret_cast<const unsigned char*>(msg);
+    // Current position in a message in all units, indexed by TSpanUnits
+    size_t pos[3] = {0, 0, 0};
+    auto convert = [&](size_t offset) {
+        auto& bytes = pos[static_cast<size_t>(TSpanUnits::Bytes)];
+        auto& utf8 = pos[static_cast<size_t>(TSpanUnits::Utf8)];
+        auto& utf16 = pos[static_cast<size_t>(TSpanUnits::Utf16)];
+        while (pos[static_cast<size_t>(from)] < offset && bytes < size) {
+            size_t len = (s[bytes] < 0x80) ? 1 : GetUtf8SequenceLength(s + bytes, size - bytes);
+            if (len) {
+                bytes += len;
+                utf8 += len;
+                utf16 += (len == 4) ? 2 : 1;
+            } else {
+                bytes += 1;
+                utf8 += sizeof(REPLACEMENT_CHARACTER) - 1;
+                utf16 += 1;
+            }
+        }
+        return pos[static_cast<size_t>(to)];
+    };
+    for (auto& span: spans) {
+        span.Begin = convert(span.Begin);
+        span.End = convert(span.End);
+    }
+}
+
+void AppendJsonString(std::string& out, const char* str, size_t size)
+{
+    auto s = reinterpret_cast<const unsigned char*>(str);
+    out.reserve(out.size() + size + 2);
+    out += '"';
+    size_t i = 0;
+    while (i < size) {
+        // Copy a run of characters not needing escaping at once
+        auto start = i;
+        while (i < size && s[i] >= 0x20 && s[i] < 0x80 && s[i] != '"' && s[i] != '\\') {
+            ++i;
+        }
+        out.append(str + start, i - start);
+        if (i == size) {
+            break;
+        }
+        auto c = s[i];
+        if (c >= 0x80) {
+            auto len = GetUtf8SequenceLength(s + i, size - i);
+            if (len) {
+                out.append(str + i, len);
+                i += len;
+            } else {
+                out += REPLACEMENT_CHARACTER;
+                ++i;
+            }
+            continue;
+        }
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            case '\b':
+                out += "\\b";
+                break;
+            case '\f':
+                out += "\\f";
+                break;
+            default:
+                out += "\\u00";
+                out += HEX_DIGITS[c >> 4];
+                out += HEX_DIGITS[c & 0xF];
+        }
+        ++i;
+    }
+    out += '"';
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <wblib/json_utils.h>
+
+//! Range of a message matching a search pattern, End is past the last matching character
+struct TMatchSpan
+{
+    size_t Begin;
+    size_t End;
+};
+
+//! Units of match span offsets
+enum class TSpanUnits
+{
+    //! Bytes of a raw message
+    Bytes,
+
+    //! Bytes of a message sent to clients, invalid UTF-8 sequences are replaced by U+FFFD
+    Utf8,
+
+    //! UTF-16 code units, as used by JavaScript strings
+    Utf16
+};
+
+//! Log entry sent to clients
+struct TLogEntry
+{
+    //! syslog severity level is not sent for LOG_INFO messages
+    static const int NO_LEVEL = -1;
+
+    std::string Msg;
+
+    //! UNIX timestamp in milliseconds, not sent if 0
+    uint64_t Time = 0;
+
+    int Level = NO_LEVEL;
+
+    //! Service name, not sent if empty
+    std::string Service;
+
+    //! Cursor of the entry, not sent if empty
+    std::string Cursor;
+
+    //! Parts of the message matching a search pattern, not sent if empty
+    std::vector<TMatchSpan> Spans;
+};
+
+//! Makes JSON object of an entry. Invalid UTF-8 sequences are replaced by U+FFFD as in AppendJson()
+Json::Value ToJson(const TLogEntry& entry);
+
+/**
+ * @brief Appends entry as a JSON object to a text buffer.
+ *
+ * The output is the same as serialized ToJson() result,
+ * but it is made without intermediate Json::Value objects.
+ */
+void AppendJson(std::string& out, const TLogEntry& entry);
+
+/**
+ * @brief Converts offsets of sorted non-overlapping spans in a UTF-8 message to other units.
+ *
+ * Every invalid UTF-8 byte is counted as U+FFFD character, the same as in JSON made by ToJson() and AppendJson().
+ */
+void ConvertSpans(const char* msg, size_t size, std::vector<TMatchSpan>& spans, TSpanUnits from, TSpanUnits to);
+
+//! Appends escaped and quoted JSON string to a text buffer. Invalid UTF-8 sequences are replaced by U+FFFD
+void AppendJsonString(std::string& out, const char* str, size_t size);
@@ -1,10 +1,20 @@
 #include "log_reader.h"
 
+#include "journal_entry.h"
+#include "kmsg_reader.h"
 #include "log.h"
+#include "request_params.h"
+#include "result_stream.h"
 
 #include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
 #include <set>
-#include <unicode/regex.h>
+#include <thread>
 
 #include <sys/sysinfo.h>
 #include <syslog.h>
@@ -14,8 +24,6 @@
 #include <wblib/mqtt.h>
 
 using namespace WBMQTT;
-using icu::RegexMatcher;
-using icu::UnicodeString;
 
 #define LOG(logger) ::logger.Log() << "[logs] "
 
@@ -23,82 +31,26 @@ namespace
 {
     const auto DMESG_SERVICE = "dmesg";
     const uint32_t MAX_LOG_RECORDS = 100;
+    const size_t MAX_IDLE_JOURNAL_HANDLES = 2;
+    const size_t REGEX_CACHE_SIZE = 16;
+    const unsigned int MAX_SCAN_WORKERS = 4;
+    const size_t MAX_QUEUED_SCANS = 16;
+    const uint64_t DEFAULT_HISTOGRAM_BUCKET_S = 60;
+    const uint64_t MAX_HISTOGRAM_BUCKETS = 1440;
+    const size_t MAX_QUEUED_REQUESTS = 16;
+    const size_t RESULT_CACHE_SIZE = 1024 * 1024;
+    const auto MAX_REQUEST_DURATION = std::chrono::seconds(30);
 
-    void SdThrowError(int res, const std::string& msg)
+    //! Number of requests processed concurrently
+    size_t GetWorkersCount()
     {
-        if (res < 0) {
-            throw std::runtime_error(std::string(msg) + ": " + strerror(-res));
-        }
-    }
-
-    std::vector<std::string> ExecCommand(const std::string& cmd)
-    {
-        std::unique_ptr<FILE, decltype(&pclose)> fd(popen(cmd.c_str(), "r"), pclose);
-        if (!fd) {
-            throw std::runtime_error("Cannot open pipe for '" + cmd + "'");
-        }
-        std::array<char, 256> buffer;
-        std::string result;
-        while (!feof(fd.get())) {
-            auto bytes = fread(buffer.data(), 1, buffer.size(), fd.get());
-            result.append(buffer.data(), bytes);
-        }
-        return StringSplit(result, '\n');
-    }
-
-    // Input string example:
-    // -1 e932c72aeb0b44c6a093b94797460151 Tue 2021-04-06 07:35:01 UTC—Tue 2021-04-06 07:44:15 UTC
-    Json::Value GetBootRec(const std::string& str)
-    {
-        Json::Value res;
-        std::istringstream ss(str);
-        ss.exceptions(std::ios_base::failbit | std::ios_base::badbit);
-        int bootId;
-        ss >> bootId;
-        std::string hash;
-        ss >> hash;
-        res["hash"] = hash;
-        tm t = {};
-        const auto* timeFormat = "%a %Y-%m-%d %H:%M:%S UTC";
-        ss >> std::get_time(&t, timeFormat);
-        res["start"] = Json::Value::Int64(mktime(&t));
-        if (bootId != 0) {
-            ss.seekg(3, std::ios_base::cur); // pass '—' U+2014 (0xe2, 0x80, 0x94) EM DASH
-            ss >> std::get_time(&t, timeFormat);
-            res["end"] = Json::Value::Int64(mktime(&t));
-        }
-        return res;
-    }
-
-    Json::Value GetBoots()
-    {
-        Json::Value res;
-        auto boots = ExecCommand("journalctl --utc --list-boots");
-        std::reverse(boots.begin(), boots.end());
-        for (const auto& boot: boots) {
-            try {
-                res.append(GetBootRec(boot));
-            } catch (const std::exception& e) {
-                LOG(Warn) << "Failed to parse boot string '" + boot + "'";
-            }
-        }
-        return res;
+        return std::max(1u, std::thread::hardware_concurrency());
     }
 
-    Json::Value GetServices()
+    //! Number of journal partitions scanned concurrently by a request
+    unsigned int GetScanWorkersCount()
     {
-        const char* servicePostfix = ".service";
-        const auto servicePostfixLen = strlen(servicePostfix);
-        Json::Value res(Json::arrayValue);
-        auto services = ExecCommand("systemctl list-unit-files *.service");
-        for (const auto& service: services) {
-            auto pos = service.find(servicePostfix);
-            if (pos != std::string::npos) {
-                res.append(service.substr(0, pos + servicePostfixLen));
-            }
-        }
-        res.append(DMESG_SERVICE);
-        return res;
+        return std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_SCAN_WORKERS));
     }
 
     uint32_t GetMaxLogsEntries(const Json::Value& params)
@@ -106,17 +58,6 @@ namespace
         return std::min(MAX_LOG_RECORDS, params.get("limit", MAX_LOG_RECORDS).asUInt());
     }
 
-    const char* GetData(sd_journal* j, const std::string& fieldName)
-    {
-        const char* d;
-        size_t l;
-        int r = sd_journal_get_data(j, fieldName.c_str(), (const void**)&d, &l);
-        if (r == 0 && l > fieldName.size() + 1) {
-            return d + fieldName.size() + 1;
-        }
-        return nullptr;
-    }
-
     struct TJournalctlFilterParams
     {
         bool Backward = true;
@@ -124,38 +65,44 @@ namespace
         uint32_t MaxEntries = MAX_LOG_RECORDS;
         std::chrono::microseconds From = std::chrono::microseconds::zero();
         std::string Cursor;
-        UnicodeString Pattern;
-        bool CaseSensitive = true;
-        bool RegEx = false;
+        TMessageMatcher Matcher;
+
+        //! Maximum number of journal entries to look through, 0 - unlimited
+        uint64_t ScanLimit = 0;
+        //! Maximum request processing time, 0 - unlimited
+        std::chrono::milliseconds TimeLimit = std::chrono::milliseconds::zero();
     };
 
-    TJournalctlFilterParams SetFilter(sd_journal* j, const Json::Value& params)
+    bool IsBackwardRequest(const Json::Value& params)
+    {
+        return (params["cursor"].get("direction", "backward").asString() == "backward");
+    }
+
+    //! Adds journal matches for service, boot and levels request params
+    void AddJournalMatches(sd_journal* j, const Json::Value& params)
     {
-        TJournalctlFilterParams filter;
         auto service = params.get("service", "").asString();
         if (!service.empty()) {
             SdThrowError(sd_journal_add_match(j, ("_SYSTEMD_UNIT=" + service).c_str(), 0), "Adding match failed");
-            filter.Service = service;
         }
 
-        filter.MaxEntries = GetMaxLogsEntries(params);
-
         auto boot = params.get("boot", "").asString();
         if (!boot.empty()) {
             sd_journal_add_match(j, ("_BOOT_ID=" + boot).c_str(), 0);
         }
 
-        std::set<int> levels;
-        for (const auto& lv: params["levels"]) {
-            if (lv.isInt()) {
-                int l = lv.asInt();
-                if (l >= LOG_EMERG && l <= LOG_DEBUG && 0 == levels.count(l)) {
-                    levels.insert(l);
-                    SdThrowError(sd_journal_add_match(j, ("PRIORITY=" + std::to_string(l)).c_str(), 0),
-                                 "Adding match failed");
-                }
-            }
+        for (auto l: GetLevels(params)) {
+            SdThrowError(sd_journal_add_match(j, ("PRIORITY=" + std::to_string(l)).c_str(), 0),
+                         "Adding match failed");
         }
+    }
+
+    TJournalctlFilterParams SetFilter(sd_journal* j, const Json::Value& params, TRegexCache& regexCache)
+    {
+        TJournalctlFilterParams filter;
+        AddJournalMatches(j, params);
+        filter.Service = params.get("service", "").asString();
+        filter.MaxEntries = GetMaxLogsEntries(params);
 
         if (params.isMember("time")) {
             filter.From = std::chrono::microseconds(params["time"].asInt64() * 1000000);
@@ -163,234 +110,867 @@ namespace
 
         if (params.isMember("cursor")) {
             auto& cursor = params["cursor"];
-            filter.Cursor = cursor.get("id", "").asString();
-            filter.Backward = (cursor.get("direction", "backward").asString() == "backward");
+            filter.Cursor = ExpandCursor(cursor.get("id", "").asString());
+            filter.Backward = IsBackwardRequest(params);
         }
 
-        filter.Pattern = UnicodeString::fromUTF8(params.get("pattern", "").asString());
-        filter.CaseSensitive = params.get("case-sensitive", true).asBool();
-        filter.RegEx = params.get("regex", false).asBool();
+        filter.Matcher = MakeMatcher(params, regexCache);
+
+        filter.ScanLimit = params.get("scan-limit", 0).asUInt64();
+        filter.TimeLimit = std::chrono::milliseconds(params.get("time-limit", 0).asUInt64());
 
         return filter;
     }
 
-    bool HasSubstring(const UnicodeString& msg, const UnicodeString& pattern, bool caseSensitive)
+    TLogEntry MakeDmesgEntry(const TKmsgRecord& record, std::chrono::system_clock::time_point bootTime)
     {
-        if (caseSensitive) {
-            return (msg.indexOf(pattern) >= 0);
+        TLogEntry entry;
+        UnescapeKmsg(record.Msg, record.MsgSize, entry.Msg);
+        auto t = bootTime + std::chrono::microseconds(record.Timestamp);
+        entry.Time = std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
+        if (record.Level != LOG_INFO) {
+            entry.Level = record.Level;
         }
-        return (UnicodeString(msg).foldCase().indexOf(UnicodeString(pattern).foldCase()) >= 0);
+        return entry;
     }
 
-    bool MatchesRegex(const UnicodeString& msg, const UnicodeString& pattern, bool caseSensitive)
+    //! Called for every entry of a Load result in the order entries are read
+    typedef std::function<void(TLogEntry& entry)> TEntryHandler;
+
+    struct TScanResult
     {
-        UErrorCode status = U_ZERO_ERROR;
-        RegexMatcher m(pattern, (caseSensitive ? 0 : UREGEX_CASE_INSENSITIVE), status);
-        if (U_FAILURE(status)) {
-            throw std::runtime_error("Could not create a RegexMatcher object");
-        }
-        m.reset(msg);
-        bool ok = m.find(status);
-        if (U_FAILURE(status)) {
-            throw std::runtime_error("Error searching for pattern");
-        }
-        return ok;
+        uint64_t Scanned = 0;
+        uint64_t Matched = 0;
+
+        //! Cursors of the first and the last matched entries in the order of reading.
+        //! Entries passed to TEntryHandler don't have cursors
+        std::string FirstCursor;
+        std::string LastCursor;
+
+        //! Object with a cursor of the last scanned entry, set if the scan budget is exhausted or the deadline
+        //! is reached. It is sent in the trailing object or, for clients not expecting it, in the last read entry
+        Json::Value SearchCursor;
+
+        //! The scan is stopped by the request deadline, the result is partial
+        bool DeadlineExceeded = false;
+    };
+
+    //! Returns time after which request processing is stopped regardless of its params
+    std::chrono::steady_clock::time_point GetRequestDeadline()
+    {
+        return std::chrono::steady_clock::now() + MAX_REQUEST_DURATION;
     }
 
-    Json::Value ParseDmesgLog(const std::string& line, std::chrono::system_clock::time_point bootTime)
+    //! dmesg cursor id is a kernel sequence number of a record
+    uint64_t ParseDmesgCursor(const std::string& id)
     {
-        Json::Value entry;
-        size_t p = 0;
-        if (line[0] == '[') {
-            auto sec = strtod(line.c_str() + 1, nullptr);
-            auto t = bootTime + std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(sec * 1000));
-            entry["time"] = std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
-            p = line.find(']');
-            p = (p == std::string::npos) ? 0 : p + 1;
-            if (line[p] == ' ') {
-                ++p;
-            }
+        char* end = nullptr;
+        errno = 0;
+        auto seqnum = strtoull(id.c_str(), &end, 10);
+        if (id.empty() || *end != '\0' || errno != 0) {
+            throw std::runtime_error("Invalid dmesg cursor: " + id);
         }
-        entry["msg"] = line.substr(p);
-        return entry;
+        return seqnum;
     }
 
-    Json::Value GetDmesgLogs(const Json::Value& params, std::chrono::system_clock::time_point bootTime)
+    /**
+     * @brief Reads kernel log records according to request params.
+     *
+     * /dev/kmsg can be read only from the oldest record. Forward requests stop as soon as
+     * the requested number of entries is found. Backward requests keep the last matched entries
+     * and stop on reaching the cursor or the time from the request.
+     */
+    TScanResult GetDmesgLogs(const Json::Value& params,
+                             std::chrono::system_clock::time_point bootTime,
+                             std::atomic_bool& cancelLoading,
+                             TRegexCache& regexCache,
+                             const TEntryHandler& onEntry)
     {
-        Json::Value res(Json::arrayValue);
+        TScanResult res;
 
-        auto pattern = UnicodeString::fromUTF8(params.get("pattern", "").asString());
-        auto caseSensitive = params.get("case-sensitive", true).asBool();
-        auto regEx = params.get("regex", false).asBool();
+        auto deadline = GetRequestDeadline();
+        auto maxEntries = GetMaxLogsEntries(params);
+        auto backward = IsBackwardRequest(params);
+        auto levels = GetLevels(params);
+        auto matcher = MakeMatcher(params, regexCache);
+        matcher.SetDeadline(deadline, &cancelLoading);
 
-        for (const auto& s: ExecCommand("dmesg --color=never --force-prefix")) {
-            Json::Value entry(ParseDmesgLog(s, bootTime));
+        auto cursorId = params["cursor"].get("id", "").asString();
+        bool hasCursor = !cursorId.empty();
+        uint64_t cursor = hasCursor ? ParseDmesgCursor(cursorId) : 0;
 
-            if (!pattern.isEmpty()) {
-                auto msg = UnicodeString::fromUTF8(entry["msg"].asString());
-                if (regEx) {
-                    if (!MatchesRegex(msg, pattern, caseSensitive)) {
-                        continue;
-                    }
-                } else {
-                    if (!HasSubstring(msg, pattern, caseSensitive)) {
-                        continue;
+        // Time from the request as microseconds since boot
+        uint64_t from = 0;
+        if (!hasCursor && params.isMember("time")) {
+            auto t = std::chrono::system_clock::time_point(std::chrono::seconds(params["time"].asInt64()));
+            from = (t > bootTime) ? std::chrono::duration_cast<std::chrono::microseconds>(t - bootTime).count() : 1;
+        }
+
+        auto addEntry = [&](TLogEntry& entry) {
+            if (res.Matched == 0) {
+                res.FirstCursor = entry.Cursor;
+            }
+            res.LastCursor = entry.Cursor;
+            entry.Cursor.clear();
+            ++res.Matched;
+            onEntry(entry);
+        };
+
+        std::deque<TLogEntry> lastEntries;
+        TKmsgReader reader;
+        TKmsgRecord record;
+        while (maxEntries && !cancelLoading && reader.Next(record)) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                res.DeadlineExceeded = true;
+                break;
+            }
+            if (backward) {
+                if (hasCursor ? record.Seqnum >= cursor : (from && record.Timestamp > from)) {
+                    break;
+                }
+            } else if (hasCursor ? record.Seqnum <= cursor : (from && record.Timestamp < from)) {
+                continue;
+            }
+
+            ++res.Scanned;
+            if (!levels.empty() && !levels.count(record.Level)) {
+                continue;
+            }
+            auto entry(MakeDmesgEntry(record, bootTime));
+            if (!matcher.IsEmpty()) {
+                if (!matcher.Match(entry.Msg.data(), entry.Msg.size())) {
+                    // The interrupted record isn't checked, stop the scan without it
+                    if (matcher.IsInterrupted()) {
+                        --res.Scanned;
+                        res.DeadlineExceeded = !cancelLoading;
+                        break;
                     }
+                    continue;
                 }
+                entry.Spans = matcher.GetSpans();
             }
+            entry.Cursor = std::to_string(record.Seqnum);
 
-            res.append(entry);
+            if (backward) {
+                lastEntries.push_back(std::move(entry));
+                if (lastEntries.size() > maxEntries) {
+                    lastEntries.pop_front();
+                }
+            } else {
+                --maxEntries;
+                addEntry(entry);
+            }
+        }
+        // Backward requests read the buffer from the oldest record, so a stopped scan misses the newest matches
+        if (res.DeadlineExceeded) {
+            lastEntries.clear();
+        }
+        for (auto it = lastEntries.rbegin(); it != lastEntries.rend(); ++it) {
+            addEntry(*it);
         }
         return res;
     }
 
-    // libwbmqtt1 log prefixes to syslog severity levels map
-    const std::vector<std::pair<std::string, int>> LibWbMqttLogLevels = {{"ERROR:", LOG_ERR},
-                                                                         {"WARNING:", LOG_WARNING},
-                                                                         {"DEBUG:", LOG_DEBUG}};
+    bool IsScanBudgetExhausted(const TJournalctlFilterParams& filter,
+                               uint64_t scannedEntries,
+                               std::chrono::steady_clock::time_point startTime)
+    {
+        if (filter.ScanLimit && scannedEntries >= filter.ScanLimit) {
+            return true;
+        }
+        return (filter.TimeLimit.count() > 0 && std::chrono::steady_clock::now() - startTime >= filter.TimeLimit);
+    }
 
-    bool AddMsg(sd_journal* j, Json::Value& entry, const UnicodeString& pattern, bool caseSensitive, bool regEx)
+    /**
+     * @brief Reads journal entries according to request params.
+     *
+     * If the scan budget is exhausted before the requested number of entries is found,
+     * the result has a search cursor pointing to the last scanned entry.
+     * It can be used in the next request to continue the search.
+     */
+    TScanResult MakeJouralctlRequest(sd_journal* j,
+                                     const Json::Value& params,
+                                     std::chrono::steady_clock::time_point deadline,
+                                     std::atomic_bool& cancelLoading,
+                                     TRegexCache& regexCache,
+                                     const TEntryHandler& onEntry)
     {
-        const char* d = GetData(j, "MESSAGE");
-        if (d == nullptr) {
-            return false;
+        TScanResult res;
+        auto startTime = std::chrono::steady_clock::now();
+        auto filter = SetFilter(j, params, regexCache);
+        // Matching of a single message is interrupted by time-limit too
+        auto matchDeadline = deadline;
+        if (filter.TimeLimit.count() > 0) {
+            matchDeadline = std::min(deadline, startTime + filter.TimeLimit);
+        }
+        filter.Matcher.SetDeadline(matchDeadline, &cancelLoading);
+
+        auto moveFn = filter.Backward ? sd_journal_previous : sd_journal_next;
+        if (!filter.Cursor.empty()) {
+            SdThrowError(sd_journal_seek_cursor(j, filter.Cursor.c_str()), "Failed to seek to tail of journal");
+            if (!filter.Backward) {
+                moveFn(j); // Pass pointed by cursor record
+            }
+        } else if (filter.From.count() > 0) {
+            SdThrowError(sd_journal_seek_realtime_usec(j, filter.From.count()), "Failed to seek to tail of journal");
+        } else {
+            SdThrowError(sd_journal_seek_tail(j), "Failed to seek to tail of journal");
         }
-        if (!pattern.isEmpty()) {
-            auto msg = UnicodeString::fromUTF8(d);
-            if (regEx) {
-                if (!MatchesRegex(msg, pattern, caseSensitive)) {
-                    return false;
+
+        // Cursors are formatted only for the first and the last matched entries.
+        // The last one is not known until the scan ends, so we count moves to get back to it.
+        uint64_t movesAfterMatch = 0;
+        auto moveBackFn = filter.Backward ? sd_journal_next : sd_journal_previous;
+        int r = moveFn(j);
+        while (r > 0 && filter.MaxEntries && !cancelLoading) {
+            ++res.Scanned;
+            TLogEntry item;
+            if (AddMsg(j, item, filter.Matcher)) {
+                AddTimestamp(j, item);
+                AddPriority(j, item);
+                if (filter.Service.empty()) {
+                    AddService(j, item);
                 }
-            } else {
-                if (!HasSubstring(msg, pattern, caseSensitive)) {
-                    return false;
+                ++res.Matched;
+                --filter.MaxEntries;
+                movesAfterMatch = 0;
+                if (res.Matched == 1) {
+                    res.FirstCursor = GetCursor(j);
+                    res.LastCursor = res.FirstCursor;
+                } else if (filter.MaxEntries == 0) {
+                    res.LastCursor = GetCursor(j);
                 }
+                onEntry(item);
             }
-        }
-        entry["msg"] = d;
-        if (!entry.isMember("level")) {
-            std::any_of(LibWbMqttLogLevels.begin(), LibWbMqttLogLevels.end(), [&](const auto& p) {
-                if (StringStartsWith(d, p.first)) {
-                    entry["level"] = p.second;
-                    return true;
+            if (filter.MaxEntries && std::chrono::steady_clock::now() >= deadline) {
+                res.DeadlineExceeded = true;
+            }
+            auto interrupted = filter.Matcher.IsInterrupted();
+            if (filter.MaxEntries &&
+                (interrupted || res.DeadlineExceeded || IsScanBudgetExhausted(filter, res.Scanned, startTime)))
+            {
+                // The interrupted entry isn't checked, so the search cursor points to the previous one
+                std::string searchCursor;
+                if (!interrupted) {
+                    searchCursor = GetCursor(j);
+                } else if (--res.Scanned && moveBackFn(j) > 0) {
+                    --movesAfterMatch;
+                    searchCursor = GetCursor(j);
+                } else if (res.Scanned == 0) {
+                    searchCursor = filter.Cursor;
                 }
-                return false;
-            });
+                if (!searchCursor.empty()) {
+                    res.SearchCursor["id"] = searchCursor;
+                    res.SearchCursor["direction"] = filter.Backward ? "backward" : "forward";
+                }
+                break;
+            }
+            r = moveFn(j);
+            if (r > 0) {
+                ++movesAfterMatch;
+            }
+        }
+
+        if (r < 0) {
+            // The journal position is unknown, so the last matched entry can't be reached to get its cursor
+            if (res.Matched > 1 && filter.MaxEntries) {
+                SdThrowError(r, "Failed to get next journal entry");
+            }
+            LOG(Error) << "Failed to get next journal entry: " << strerror(-r);
+        } else if (res.Matched > 1 && filter.MaxEntries) {
+            for (; movesAfterMatch && moveBackFn(j) > 0; --movesAfterMatch) {
+            }
+            res.LastCursor = (movesAfterMatch == 0) ? GetCursor(j) : std::string();
         }
-        return true;
+        return res;
     }
 
-    void AddTimestamp(sd_journal* j, Json::Value& entry)
+    //! Returns true if position a is closer to the scan start than position b
+    bool IsBefore(const TJournalPosition& a, const TJournalPosition& b, bool backward)
     {
-        uint64_t ts;
-        SdThrowError(sd_journal_get_realtime_usec(j, &ts), "Failed to read timestamp");
-        // __REALTIME_TIMESTAMP is in microseconds, convert it to milliseconds
-        entry["time"] = ts / 1000;
+        auto res = CompareJournalPositions(a, b);
+        return backward ? (res > 0) : (res < 0);
     }
 
-    void AddPriority(sd_journal* j, Json::Value& entry)
+    //! Scan boundary shared by partition workers.
+    //! Entries beyond the boundary can't get into the result,
+    //! because some worker has already found enough entries closer to the scan start.
+    //! Positions are compared in sd-journal order, so the order matches the partition scan order.
+    class TScanBoundary
     {
-        const char* d = GetData(j, "PRIORITY");
-        if (d == nullptr) {
-            return;
+    public:
+        explicit TScanBoundary(bool backward): Backward(backward), Set(false)
+        {}
+
+        //! Positions of scanned entries are needed only after the boundary is set
+        bool IsSet() const
+        {
+            return Set;
         }
-        auto level = atoi(d);
-        // journald sets LOG_INFO priority for all unprefixed messages got fom stderr/stdout
-        // They priority is set in ParseMsg according to a prefix.
-        if (level != LOG_INFO && !entry.isMember("level")) {
-            entry["level"] = level;
+
+        bool IsBeyond(const TJournalPosition& position)
+        {
+            std::unique_lock<std::mutex> lk(Mutex);
+            return Set && IsBefore(Value, position, Backward);
+        }
+
+        void Update(const TJournalPosition& position)
+        {
+            std::unique_lock<std::mutex> lk(Mutex);
+            if (!Set || IsBefore(position, Value, Backward)) {
+                Value = position;
+                Set = true;
+            }
         }
-    }
 
-    void AddCursor(sd_journal* j, Json::Value& entry)
+    private:
+        bool Backward;
+        std::atomic_bool Set;
+        std::mutex Mutex;
+        TJournalPosition Value;
+    };
+
+    struct TPartitionEntry
     {
-        char* k = nullptr;
-        SdThrowError(sd_journal_get_cursor(j, &k), "Failed to get cursor");
-        entry["cursor"] = k;
-        free(k);
-    }
+        TJournalPosition Position;
+        TLogEntry Item;
+    };
 
-    void AddService(sd_journal* j, Json::Value& entry)
+    //! Reads cursor and position of current journal entry
+    void GetPosition(sd_journal* j, std::string& cursor, TJournalPosition& position)
     {
-        const char* d = GetData(j, "_SYSTEMD_UNIT");
-        if (d == nullptr) {
-            return;
-        }
-        std::string s(d);
-        const std::string SERVICE_SUFFIX(".service");
-        if (WBMQTT::StringHasSuffix(s, SERVICE_SUFFIX)) {
-            entry["service"] = s.substr(0, s.length() - SERVICE_SUFFIX.length());
-        } else {
-            entry["service"] = s;
+        cursor = GetCursor(j);
+        if (!ParseCursor(cursor, position)) {
+            throw std::runtime_error("Invalid journal cursor: " + cursor);
         }
     }
 
-    Json::Value MakeJouralctlRequest(const Json::Value& params, std::atomic_bool& cancelLoading)
+    struct TPartitionResult
     {
-        Json::Value res(Json::arrayValue);
-        sd_journal* j = nullptr;
-        SdThrowError(sd_journal_open(&j, SD_JOURNAL_LOCAL_ONLY), "Failed to open journal");
-        std::unique_ptr<sd_journal, decltype(&sd_journal_close)> journalPtr(j, &sd_journal_close);
+        std::vector<TPartitionEntry> Entries;
+
+        //! The scan is stopped by the request deadline
+        bool DeadlineExceeded = false;
+
+        //! Position and cursor of the last scanned entry of a stopped scan, the cursor is empty if nothing is scanned
+        TJournalPosition StopPosition;
+        std::string StopCursor;
+    };
 
-        auto filter = SetFilter(j, params);
+    TPartitionResult ScanPartition(sd_journal* j,
+                                   const Json::Value& params,
+                                   std::chrono::steady_clock::time_point deadline,
+                                   std::atomic_bool& cancelLoading,
+                                   TRegexCache& regexCache,
+                                   TScanBoundary& boundary,
+                                   std::atomic<uint64_t>& scannedEntries)
+    {
+        TPartitionResult res;
+        auto filter = SetFilter(j, params, regexCache);
+        filter.Matcher.SetDeadline(deadline, &cancelLoading);
 
         auto moveFn = filter.Backward ? sd_journal_previous : sd_journal_next;
+        int r;
         if (!filter.Cursor.empty()) {
             SdThrowError(sd_journal_seek_cursor(j, filter.Cursor.c_str()), "Failed to seek to tail of journal");
-            if (!filter.Backward) {
-                moveFn(j); // Pass pointed by cursor record
+            r = moveFn(j);
+            // Only one partition has the record pointed by cursor
+            if (r > 0 && !filter.Backward && sd_journal_test_cursor(j, filter.Cursor.c_str()) > 0) {
+                r = moveFn(j);
             }
-        } else if (filter.From.count() > 0) {
-            SdThrowError(sd_journal_seek_realtime_usec(j, filter.From.count()), "Failed to seek to tail of journal");
         } else {
-            SdThrowError(sd_journal_seek_tail(j), "Failed to seek to tail of journal");
+            if (filter.From.count() > 0) {
+                SdThrowError(sd_journal_seek_realtime_usec(j, filter.From.count()),
+                             "Failed to seek to tail of journal");
+            } else {
+                SdThrowError(sd_journal_seek_tail(j), "Failed to seek to tail of journal");
+            }
+            r = moveFn(j);
         }
 
-        int r = moveFn(j);
-        while (r > 0 && filter.MaxEntries && !cancelLoading) {
-            Json::Value item;
-            if (AddMsg(j, item, filter.Pattern, filter.CaseSensitive, filter.RegEx)) {
+        uint64_t scanned = 0;
+        // Remembers the last scanned entry, the journal is positioned at the next one
+        auto stop = [&] {
+            res.DeadlineExceeded = !cancelLoading;
+            auto moveBackFn = filter.Backward ? sd_journal_next : sd_journal_previous;
+            if (scanned && moveBackFn(j) > 0) {
+                GetPosition(j, res.StopCursor, res.StopPosition);
+            }
+        };
+        while (r > 0 && res.Entries.size() < filter.MaxEntries && !cancelLoading) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                stop();
+                break;
+            }
+            TLogEntry item;
+            TJournalPosition position;
+            if (boundary.IsSet()) {
+                GetPosition(j, item.Cursor, position);
+                if (boundary.IsBeyond(position)) {
+                    break;
+                }
+            }
+            ++scanned;
+            if (AddMsg(j, item, filter.Matcher)) {
                 AddTimestamp(j, item);
-                AddCursor(j, item);
+                if (item.Cursor.empty()) {
+                    GetPosition(j, item.Cursor, position);
+                }
                 AddPriority(j, item);
                 if (filter.Service.empty()) {
                     AddService(j, item);
                 }
-                res.append(item);
-                --filter.MaxEntries;
+                res.Entries.push_back({std::move(position), std::move(item)});
+            } else if (filter.Matcher.IsInterrupted()) {
+                // The interrupted entry isn't checked
+                --scanned;
+                stop();
+                break;
             }
             r = moveFn(j);
         }
+        scannedEntries += scanned;
 
         if (r < 0) {
             LOG(Error) << "Failed to get next journal entry: " << strerror(-r);
         }
+        if (filter.MaxEntries && res.Entries.size() == filter.MaxEntries) {
+            boundary.Update(res.Entries.back().Position);
+        }
+        return res;
+    }
 
-        // Forward queries return rows in ascending order, but we want a descending order
-        if (!filter.Backward) {
-            std::reverse(res.begin(), res.end());
+    /**
+     * @brief K-way merge of partitions results in sd-journal order in the scan direction.
+     *
+     * The order is the same as of the sequential scan, so cursors of both ways page consistently.
+     * Partitions stopped by the deadline have scanned up to different positions.
+     * The result is cut at the stop point closest to the scan start, so it has no gaps,
+     * and the search cursor is set to the stop point. Clients get it in the last read entry marked as partial.
+     */
+    void MergePartitions(std::vector<TPartitionResult>& partitions,
+                         bool backward,
+                         uint32_t maxEntries,
+                         const TEntryHandler& onEntry,
+                         TScanResult& result)
+    {
+        const TPartitionResult* stopped = nullptr;
+        for (const auto& partition: partitions) {
+            if (!partition.DeadlineExceeded) {
+                continue;
+            }
+            // Nothing is scanned, so the stop point is the scan start
+            if (partition.StopCursor.empty()) {
+                stopped = &partition;
+                break;
+            }
+            if (!stopped || IsBefore(partition.StopPosition, stopped->StopPosition, backward)) {
+                stopped = &partition;
+            }
+        }
+        auto isBeyondStop = [&](const TJournalPosition& position) {
+            if (!stopped) {
+                return false;
+            }
+            if (stopped->StopCursor.empty()) {
+                return true;
+            }
+            return IsBefore(stopped->StopPosition, position, backward);
+        };
+
+        // position and partition index of the next entry of a partition
+        typedef std::pair<const TJournalPosition*, size_t> THead;
+        auto cmp = [backward](const THead& a, const THead& b) {
+            auto res = CompareJournalPositions(*a.first, *b.first);
+            if (res != 0) {
+                return backward ? (res < 0) : (res > 0);
+            }
+            return a.second > b.second;
+        };
+        std::priority_queue<THead, std::vector<THead>, decltype(cmp)> heads(cmp);
+        std::vector<size_t> positions(partitions.size(), 0);
+        for (size_t i = 0; i < partitions.size(); ++i) {
+            if (!partitions[i].Entries.empty()) {
+                heads.push({&partitions[i].Entries[0].Position, i});
+            }
+        }
+        while (!heads.empty() && result.Matched < maxEntries && !isBeyondStop(*heads.top().first)) {
+            auto i = heads.top().second;
+            heads.pop();
+            auto& item = partitions[i].Entries[positions[i]].Item;
+            if (result.Matched == 0) {
+                result.FirstCursor = item.Cursor;
+            }
+            result.LastCursor.swap(item.Cursor);
+            item.Cursor.clear();
+            onEntry(item);
+            ++result.Matched;
+            if (++positions[i] < partitions[i].Entries.size()) {
+                heads.push({&partitions[i].Entries[positions[i]].Position, i});
+            }
+        }
+        // The result is complete if it has enough entries before the stop point
+        if (stopped && result.Matched < maxEntries) {
+            result.DeadlineExceeded = true;
+            if (!stopped->StopCursor.empty()) {
+                result.SearchCursor["id"] = stopped->StopCursor;
+                result.SearchCursor["direction"] = backward ? "backward" : "forward";
+            }
+        }
+    }
+
+    /**
+     * @brief Reads journal entries according to request params scanning journal files partitions concurrently.
+     *
+     * Every worker scans its own partition and finds up to limit entries,
+     * the result is merged from workers results.
+     * Workers don't know which entries will be the first and the last in the result,
+     * so they read cursors of all matched entries.
+     * The calling thread scans one partition, others are scanned by shared scan workers,
+     * so the number of scanning threads doesn't grow with concurrent requests.
+     * A partition is scanned by the calling thread too if the scan workers queue is full.
+     */
+    TScanResult MakeParallelJouralctlRequest(const std::vector<PJournalPool>& partitions,
+                                             TWorkerPool& scanWorkers,
+                                             const Json::Value& params,
+                                             std::atomic_bool& cancelLoading,
+                                             TRegexCache& regexCache,
+                                             const TEntryHandler& onEntry)
+    {
+        auto deadline = GetRequestDeadline();
+        TScanBoundary boundary(IsBackwardRequest(params));
+        std::atomic<uint64_t> scannedEntries(0);
+        std::vector<TPartitionResult> results(partitions.size());
+        std::vector<std::exception_ptr> errors(partitions.size());
+        std::mutex mutex;
+        std::condition_variable scanned;
+        size_t running = partitions.size();
+        auto scan = [&](size_t i) {
+            try {
+                auto journal(partitions[i]->Acquire());
+                results[i] = ScanPartition(journal.get(),
+                                           params,
+                                           deadline,
+                                           cancelLoading,
+                                           regexCache,
+                                           boundary,
+                                           scannedEntries);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+            // Notified under the lock, so the waiting thread can't leave before notification
+            std::unique_lock<std::mutex> lk(mutex);
+            if (--running == 0) {
+                scanned.notify_all();
+            }
+        };
+        for (size_t i = 1; i < partitions.size(); ++i) {
+            if (!scanWorkers.Post([&scan, i] { scan(i); })) {
+                scan(i);
+            }
+        }
+        scan(0);
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            scanned.wait(lk, [&running] { return running == 0; });
+        }
+        for (const auto& error: errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
         }
+        TScanResult res;
+        res.Scanned = scannedEntries;
+        MergePartitions(results, IsBackwardRequest(params), GetMaxLogsEntries(params), onEntry, res);
         return res;
     }
 
-    Json::Value GetJouralctlLogs(const Json::Value& params, std::atomic_bool& cancelLoading)
+    //! Concurrent scan pays off only for CPU-bound pattern or query search.
+    //! Partitions can't provide a single search cursor, so requests with a scan budget are processed sequentially.
+    //! Streamed results are sent while reading, so they are not delayed by merging.
+    bool IsParallelScanUseful(const Json::Value& params)
     {
-        Json::Value res(MakeJouralctlRequest(params, cancelLoading));
-        if (res.size() > 2) {
-            // cursor is needed only for the first and the last record
-            std::for_each(++res.begin(), --res.end(), [](auto& item) { item.removeMember("cursor"); });
+        auto hasFilter = !params.get("pattern", "").asString().empty() || !params.get("query", "").asString().empty();
+        return hasFilter && !params.isMember("scan-limit") && !params.isMember("time-limit") &&
+               !params.isMember("stream");
+    }
+
+    TScanResult GetJouralctlLogs(TJournalPool& journalPool,
+                                 TJournalPartitions& journalPartitions,
+                                 TWorkerPool& scanWorkers,
+                                 const Json::Value& params,
+                                 std::atomic_bool& cancelLoading,
+                                 TRegexCache& regexCache,
+                                 const TEntryHandler& onEntry)
+    {
+        std::vector<PJournalPool> partitions;
+        auto workers = GetScanWorkersCount();
+        if (workers > 1 && IsParallelScanUseful(params)) {
+            partitions = journalPartitions.Get(workers);
+        }
+
+        TScanResult res;
+        if (partitions.size() > 1) {
+            res = MakeParallelJouralctlRequest(partitions, scanWorkers, params, cancelLoading, regexCache, onEntry);
+        } else {
+            auto journal(journalPool.Acquire());
+            res = MakeJouralctlRequest(journal.get(), params, GetRequestDeadline(), cancelLoading, regexCache, onEntry);
+        }
+
+        if (params.get("compact-cursor", false).asBool()) {
+            res.FirstCursor = MakeCompactCursor(res.FirstCursor);
+            res.LastCursor = MakeCompactCursor(res.LastCursor);
+            if (!res.SearchCursor.isNull()) {
+                res.SearchCursor["id"] = MakeCompactCursor(res.SearchCursor["id"].asString());
+            }
         }
         return res;
     }
 
-    Json::Value GetLogs(const Json::Value& params,
+    bool IsDmesgRequest(const Json::Value& params)
+    {
+        return (params.get("service", "").asString() == DMESG_SERVICE);
+    }
+
+    /**
+     * @brief Reads entries for Load request without stream.
+     *
+     * The trailing object with search cursor is added only for clients requesting scan-limit or time-limit,
+     * others don't expect it in the array of entries. For them a result stopped by the deadline is marked
+     * by fields of the last read entry, or the request fails if nothing is found,
+     * so the partial result isn't taken for the end of the journal.
+     */
+    Json::Value GetLogs(TJournalPool& journalPool,
+                        TJournalPartitions& journalPartitions,
+                        TWorkerPool& scanWorkers,
+                        TRegexCache& regexCache,
+                        const Json::Value& params,
                         std::atomic_bool& cancelLoading,
-                        std::chrono::system_clock::time_point bootTime)
+                        std::chrono::system_clock::time_point bootTime,
+                        bool& deadlineExceeded)
+    {
+        std::vector<TLogEntry> entries;
+        auto appendEntry = [&entries](TLogEntry& entry) { entries.push_back(std::move(entry)); };
+        TScanResult scan;
+        if (IsDmesgRequest(params)) {
+            scan = GetDmesgLogs(params, bootTime, cancelLoading, regexCache, appendEntry);
+        } else {
+            scan = GetJouralctlLogs(journalPool,
+                                    journalPartitions,
+                                    scanWorkers,
+                                    params,
+                                    cancelLoading,
+                                    regexCache,
+                                    appendEntry);
+        }
+        // cursor is needed only for the first and the last record
+        if (!entries.empty()) {
+            entries.front().Cursor = scan.FirstCursor;
+            entries.back().Cursor = scan.LastCursor;
+        }
+        // Forward queries return rows in ascending order, but we want a descending order
+        if (!IsBackwardRequest(params)) {
+            std::reverse(entries.begin(), entries.end());
+        }
+
+        Json::Value res(Json::arrayValue);
+        for (const auto& entry: entries) {
+            res.append(ToJson(entry));
+        }
+        deadlineExceeded = scan.DeadlineExceeded;
+        if (!params.isMember("scan-limit") && !params.isMember("time-limit")) {
+            if (scan.DeadlineExceeded) {
+                if (res.empty()) {
+                    throw std::runtime_error(
+                        "Request deadline is exceeded, use scan-limit or time-limit to continue search");
+                }
+                auto& lastRead = res[IsBackwardRequest(params) ? res.size() - 1 : 0];
+                lastRead["partial"] = true;
+                if (!scan.SearchCursor.isNull()) {
+                    lastRead["search-cursor"] = scan.SearchCursor;
+                }
+            }
+            return res;
+        }
+        if (!scan.SearchCursor.isNull() || scan.DeadlineExceeded) {
+            Json::Value marker;
+            if (!scan.SearchCursor.isNull()) {
+                marker["search-cursor"] = scan.SearchCursor;
+            }
+            if (scan.DeadlineExceeded) {
+                marker["deadline-exceeded"] = true;
+            }
+            marker["scanned"] = Json::Value::UInt64(scan.Scanned);
+            res.append(marker);
+        }
+        return res;
+    }
+
+    //! Publishes entries to a stream topic while reading, returns the stream "done" frame
+    Json::Value StreamLogs(PMqttClient mqttClient,
+                           TJournalPool& journalPool,
+                           TJournalPartitions& journalPartitions,
+                           TWorkerPool& scanWorkers,
+                           TRegexCache& regexCache,
+                           const Json::Value& params,
+                           std::atomic_bool& cancelLoading,
+                           std::chrono::system_clock::time_point bootTime)
+    {
+        TResultStream stream(mqttClient, params["stream"].asString());
+        auto addEntry = [&stream](TLogEntry& entry) { stream.Add(entry); };
+        TScanResult scan;
+        if (IsDmesgRequest(params)) {
+            scan = GetDmesgLogs(params, bootTime, cancelLoading, regexCache, addEntry);
+        } else {
+            scan = GetJouralctlLogs(journalPool,
+                                    journalPartitions,
+                                    scanWorkers,
+                                    params,
+                                    cancelLoading,
+                                    regexCache,
+                                    addEntry);
+        }
+        Json::Value stats;
+        stats["scanned"] = Json::Value::UInt64(scan.Scanned);
+        stats["matched"] = Json::Value::UInt64(scan.Matched);
+        if (!scan.FirstCursor.empty()) {
+            stats["first-cursor"] = scan.FirstCursor;
+            stats["last-cursor"] = scan.LastCursor;
+        }
+        if (!scan.SearchCursor.isNull()) {
+            stats["search-cursor"] = scan.SearchCursor;
+        }
+        if (scan.DeadlineExceeded) {
+            stats["deadline-exceeded"] = true;
+        }
+        return stream.Finish(stats);
+    }
+
+    /**
+     * @brief Counts journal entries of every level in time buckets.
+     *
+     * Only timestamps and PRIORITY fields are read, counters are updated while scanning.
+     */
+    Json::Value GetHistogram(sd_journal* j, const Json::Value& params, std::atomic_bool& cancelLoading)
+    {
+        AddJournalMatches(j, params);
+
+        uint64_t head = 0;
+        uint64_t tail = 0;
+        SdThrowError(sd_journal_get_cutoff_realtime_usec(j, &head, &tail), "Failed to get journal time range");
+        const uint64_t USEC_IN_SEC = 1000000;
+        uint64_t from = params.isMember("from") ? params["from"].asUInt64() * USEC_IN_SEC : head;
+        uint64_t to = params.isMember("to") ? params["to"].asUInt64() * USEC_IN_SEC : tail + 1;
+        uint64_t bucket = DEFAULT_HISTOGRAM_BUCKET_S * USEC_IN_SEC;
+        if (params.isMember("bucket")) {
+            bucket = params["bucket"].asUInt64() * USEC_IN_SEC;
+        } else if (to > from) {
+            // The default bucket is a multiple of the minimal one fitting the range into buckets limit.
+            // One bucket is reserved for alignment of the range start
+            bucket *= (to - from) / (MAX_HISTOGRAM_BUCKETS - 1) / bucket + 1;
+        }
+        if (bucket == 0) {
+            throw std::runtime_error("Histogram bucket must be greater than zero");
+        }
+        // Align the range to bucket boundaries
+        from -= from % bucket;
+        auto bucketsCount = (to > from) ? (to - from + bucket - 1) / bucket : 0;
+        if (bucketsCount > MAX_HISTOGRAM_BUCKETS) {
+            throw std::runtime_error("Too many histogram buckets, increase bucket size");
+        }
+
+        auto deadline = GetRequestDeadline();
+        bool deadlineExceeded = false;
+        uint64_t lastTimestamp = from;
+        std::array<std::vector<uint32_t>, LOG_DEBUG + 1> counts;
+        SdThrowError(sd_journal_seek_realtime_usec(j, from), "Failed to seek journal");
+        int r = 0;
+        while (!cancelLoading && (r = sd_journal_next(j)) > 0) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                deadlineExceeded = true;
+                break;
+            }
+            uint64_t ts;
+            SdThrowError(sd_journal_get_realtime_usec(j, &ts), "Failed to read timestamp");
+            if (ts >= to) {
+                break;
+            }
+            lastTimestamp = ts;
+            if (ts < from) {
+                continue;
+            }
+            // journald sets LOG_INFO priority if it is not set explicitly
+            int level = LOG_INFO;
+            if (GetPriority(j, level) && (level < LOG_EMERG || level > LOG_DEBUG)) {
+                continue;
+            }
+            auto& levelCounts = counts[level];
+            if (levelCounts.empty()) {
+                levelCounts.resize(bucketsCount, 0);
+            }
+            ++levelCounts[(ts - from) / bucket];
+        }
+        if (r < 0) {
+            LOG(Error) << "Failed to get next journal entry: " << strerror(-r);
+        }
+
+        Json::Value res;
+        res["from"] = Json::Value::UInt64(from / USEC_IN_SEC);
+        res["bucket"] = Json::Value::UInt64(bucket / USEC_IN_SEC);
+        res["levels"] = Json::Value(Json::objectValue);
+        for (size_t level = 0; level < counts.size(); ++level) {
+            if (!counts[level].empty()) {
+                auto& levelCounts = res["levels"][std::to_string(level)];
+                for (auto count: counts[level]) {
+                    levelCounts.append(count);
+                }
+            }
+        }
+        if (deadlineExceeded) {
+            res["deadline-exceeded"] = true;
+            res["scanned-to"] = Json::Value::UInt64(lastTimestamp / USEC_IN_SEC);
+        }
+        return res;
+    }
+
+    /**
+     * @brief Returns a key of a request to find the same requests in flight.
+     *
+     * Streaming requests publish entries to their own topics, so they are not shared.
+     */
+    std::string GetRequestKey(const std::string& method, const Json::Value& params)
     {
-        if (params.get("service", "").asString() == DMESG_SERVICE) {
-            return GetDmesgLogs(params, bootTime);
+        if (params.isMember("stream")) {
+            return std::string();
         }
-        return GetJouralctlLogs(params, cancelLoading);
+        auto normalizedParams(params);
+        normalizedParams.removeMember("request-id");
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return method + ":" + Json::writeString(builder, normalizedParams);
+    }
+
+    /**
+     * @brief Checks if entries of a request result can't change until vacuuming.
+     *
+     * Backward requests from a cursor read only entries written before the cursor,
+     * other requests can get new entries. A time in the past isn't enough,
+     * because after a clock step back new entries get older timestamps.
+     * The time param overrides the cursor.
+     */
+    bool IsHistoricalRequest(const Json::Value& params)
+    {
+        return IsBackwardRequest(params) && !params.isMember("time") &&
+               !params["cursor"].get("id", "").asString().empty();
+    }
+
+    //! Returns cursor of the last journal entry, it changes on every append regardless of timestamps
+    std::string GetTailCursor(sd_journal* j)
+    {
+        SdThrowError(sd_journal_seek_tail(j), "Failed to seek to tail of journal");
+        int r = sd_journal_previous(j);
+        SdThrowError(r, "Failed to get last journal entry");
+        return (r > 0) ? GetCursor(j) : std::string();
     }
 
     std::chrono::system_clock::time_point GetBootTime()
@@ -410,40 +990,142 @@ TMQTTJournaldGateway::TMQTTJournaldGateway(PMqttClient mqttClient,
     : MqttClient(mqttClient),
       RequestsRpcServer(requestsRpcServer),
       CancelRequestsRpcServer(cancelRequestsRpcServer),
-      Boots(GetBoots()),
-      CancelLoading(false),
-      BootTime(GetBootTime())
+      JournalPool(std::max(MAX_IDLE_JOURNAL_HANDLES, GetWorkersCount())),
+      JournalPartitions(std::max(MAX_IDLE_JOURNAL_HANDLES, GetWorkersCount())),
+      RegexCache(REGEX_CACHE_SIZE),
+      ResultCache(RESULT_CACHE_SIZE),
+      Follower(mqttClient, RegexCache),
+      BootTime(GetBootTime()),
+      // The requesting thread scans one partition itself
+      ScanWorkers("wb-logs scan", std::max(1u, GetScanWorkersCount() - 1), MAX_QUEUED_SCANS),
+      Workers("wb-logs worker", GetWorkersCount(), MAX_QUEUED_REQUESTS)
 {
     RequestsRpcServer->RegisterMethod("logs",
                                       "List",
                                       std::bind(&TMQTTJournaldGateway::List, this, std::placeholders::_1));
+    RegisterQueuedMethod("Load", &TMQTTJournaldGateway::Load);
+    RegisterQueuedMethod("Histogram", &TMQTTJournaldGateway::Histogram);
+    RequestsRpcServer->RegisterMethod("logs",
+                                      "Follow",
+                                      std::bind(&TMQTTJournaldGateway::Follow, this, std::placeholders::_1));
     RequestsRpcServer->RegisterMethod("logs",
-                                      "Load",
-                                      std::bind(&TMQTTJournaldGateway::Load, this, std::placeholders::_1));
+                                      "Unfollow",
+                                      std::bind(&TMQTTJournaldGateway::Unfollow, this, std::placeholders::_1));
     CancelRequestsRpcServer->RegisterMethod("logs",
                                             "CancelLoad",
                                             std::bind(&TMQTTJournaldGateway::CancelLoad, this, std::placeholders::_1));
 }
 
+void TMQTTJournaldGateway::RegisterQueuedMethod(const std::string& name, TMethod method)
+{
+    RequestsRpcServer->RegisterAsyncMethod(
+        "logs",
+        name,
+        [this, name, method](const Json::Value& params,
+                             TMqttRpcServer::TResultCallback onResult,
+                             TMqttRpcServer::TErrorCallback onError) {
+            TInFlightRequests::PRequest request;
+            try {
+                // The token is registered before queueing, so a queued request can be cancelled too
+                auto token = Cancellations.Add(params.get("request-id", "").asString());
+                request = InFlightRequests.Add(GetRequestKey(name, params), token, onResult, onError);
+            } catch (const std::exception& e) {
+                LOG(Error) << e.what();
+                onError(E_RPC_SERVER_ERROR, e.what());
+                return;
+            }
+            if (!request) {
+                LOG(Debug) << name << " is attached to the same request in flight";
+                return;
+            }
+            auto queued = Workers.Post([this, method, params, request]() {
+                try {
+                    InFlightRequests.Complete(request, (this->*method)(params, request->Cancelled));
+                } catch (const std::exception& e) {
+                    InFlightRequests.Fail(request, E_RPC_SERVER_ERROR, e.what());
+                }
+            });
+            if (!queued) {
+                LOG(Warn) << "Too many requests, " << name << " is rejected";
+                InFlightRequests.Fail(request, E_RPC_SERVER_ERROR, "Too many requests");
+            }
+        });
+}
+
 Json::Value TMQTTJournaldGateway::List(const Json::Value& /*params*/)
 {
     LOG(Debug) << "Run RPC List()";
     Json::Value res;
     try {
-        res["boots"] = Boots;
-        res["services"] = GetServices();
+        res["boots"] = Boots.Get();
+        res["services"] = Services.Get();
+        res["services"].append(DMESG_SERVICE);
     } catch (const std::exception& e) {
         LOG(Error) << e.what();
     }
     return res;
 }
 
-Json::Value TMQTTJournaldGateway::Load(const Json::Value& params)
+Json::Value TMQTTJournaldGateway::Load(const Json::Value& params, std::atomic_bool& cancelled)
 {
     LOG(Debug) << "Run RPC Load()";
     try {
-        CancelLoading = false;
-        return GetLogs(params, CancelLoading, BootTime);
+        if (params.isMember("stream")) {
+            return StreamLogs(MqttClient,
+                              JournalPool,
+                              JournalPartitions,
+                              ScanWorkers,
+                              RegexCache,
+                              params,
+                              cancelled,
+                              BootTime);
+        }
+        if (IsDmesgRequest(params)) {
+            bool deadlineExceeded;
+            return GetLogs(JournalPool,
+                           JournalPartitions,
+                           ScanWorkers,
+                           RegexCache,
+                           params,
+                           cancelled,
+                           BootTime,
+                           deadlineExceeded);
+        }
+
+        uint64_t head = 0;
+        std::string tail;
+        {
+            auto journal(JournalPool.Acquire());
+            SdThrowError(sd_journal_get_cutoff_realtime_usec(journal.get(), &head, nullptr),
+                         "Failed to get journal time range");
+            tail = GetTailCursor(journal.get());
+        }
+        ResultCache.SetJournalHead(head);
+        // Results of requests reading the journal tail are valid until new entries are written
+        auto key = GetRequestKey("Load", params);
+        if (!IsHistoricalRequest(params)) {
+            key += ":" + tail;
+        }
+
+        Json::Value res;
+        if (ResultCache.Get(key, res)) {
+            LOG(Debug) << "Load result is taken from cache";
+            return res;
+        }
+        bool deadlineExceeded = false;
+        res = GetLogs(JournalPool,
+                      JournalPartitions,
+                      ScanWorkers,
+                      RegexCache,
+                      params,
+                      cancelled,
+                      BootTime,
+                      deadlineExceeded);
+        // Cancelled and stopped by deadline requests return partial results
+        if (!cancelled && !deadlineExceeded) {
+            ResultCache.Put(key, res);
+        }
+        return res;
     } catch (const std::exception& e) {
         LOG(Error) << e.what();
         throw;
@@ -453,6 +1135,43 @@ Json::Value TMQTTJournaldGateway::Load(const Json::Value& params)
 Json::Value TMQTTJournaldGateway::CancelLoad(const Json::Value& params)
 {
     LOG(Debug) << "Run RPC CancelLoad()";
-    CancelLoading = true;
+    Cancellations.Cancel(params.get("request-id", "").asString());
+    InFlightRequests.UpdateCancellation();
+    return Json::Value();
+}
+
+Json::Value TMQTTJournaldGateway::Histogram(const Json::Value& params, std::atomic_bool& cancelled)
+{
+    LOG(Debug) << "Run RPC Histogram()";
+    try {
+        if (IsDmesgRequest(params)) {
+            throw std::runtime_error("Histogram of dmesg is not supported");
+        }
+        auto journal(JournalPool.Acquire());
+        return GetHistogram(journal.get(), params, cancelled);
+    } catch (const std::exception& e) {
+        LOG(Error) << e.what();
+        throw;
+    }
+}
+
+Json::Value TMQTTJournaldGateway::Follow(const Json::Value& params)
+{
+    LOG(Debug) << "Run RPC Follow()";
+    try {
+        if (IsDmesgRequest(params)) {
+            throw std::runtime_error("Following dmesg is not supported");
+        }
+        return Follower.Follow(params);
+    } catch (const std::exception& e) {
+        LOG(Error) << e.what();
+        throw;
+    }
+}
+
+Json::Value TMQTTJournaldGateway::Unfollow(const Json::Value& params)
+{
+    LOG(Debug) << "Run RPC Unfollow()";
+    Follower.Unfollow(params.get("id", "").asString());
     return Json::Value();
 }
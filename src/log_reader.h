@@ -3,6 +3,16 @@
 #include <wblib/mqtt.h>
 #include <wblib/rpc.h>
 
+#include "boot_list.h"
+#include "cancellation_registry.h"
+#include "inflight_requests.h"
+#include "journal_follower.h"
+#include "journal_pool.h"
+#include "message_matcher.h"
+#include "result_cache.h"
+#include "service_list.h"
+#include "worker_pool.h"
+
 class TMQTTJournaldGateway
 {
 public:
@@ -11,14 +21,35 @@ public:
                          WBMQTT::PMqttRpcServer cancelRequestsRpcServer);
 
 private:
-    Json::Value Load(const Json::Value& params);
+    typedef Json::Value (TMQTTJournaldGateway::*TMethod)(const Json::Value& params, std::atomic_bool& cancelled);
+
+    //! Registers a cancellable method executed by the worker pool, the reply is sent when the method finishes
+    void RegisterQueuedMethod(const std::string& name, TMethod method);
+
+    Json::Value Load(const Json::Value& params, std::atomic_bool& cancelled);
     Json::Value List(const Json::Value& params);
     Json::Value CancelLoad(const Json::Value& params);
+    Json::Value Histogram(const Json::Value& params, std::atomic_bool& cancelled);
+    Json::Value Follow(const Json::Value& params);
+    Json::Value Unfollow(const Json::Value& params);
 
     WBMQTT::PMqttClient MqttClient;
     WBMQTT::PMqttRpcServer RequestsRpcServer;
     WBMQTT::PMqttRpcServer CancelRequestsRpcServer;
-    Json::Value Boots;
-    std::atomic_bool CancelLoading;
+    TJournalPool JournalPool;
+    TJournalPartitions JournalPartitions;
+    TRegexCache RegexCache;
+    TResultCache ResultCache;
+    TJournalFollower Follower;
+    TBootList Boots;
+    TServiceList Services;
+    TCancellationRegistry Cancellations;
+    TInFlightRequests InFlightRequests;
     std::chrono::system_clock::time_point BootTime;
+
+    //! Scans journal partitions for requests, it must outlive Workers waiting for scans
+    TWorkerPool ScanWorkers;
+
+    // The last member, so workers are stopped before other members are destroyed
+    TWorkerPool Workers;
 };
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+//! Least recently used cache.
+//! Every item has a cost, the oldest items are dropped when the total cost exceeds the capacity.
+//! The class is not thread-safe.
+template<class TKey, class TValue> class TLruCache
+{
+public:
+    explicit TLruCache(size_t capacity): Capacity(capacity), TotalCost(0)
+    {}
+
+    //! Returns pointer to a cached value or nullptr. The pointer is valid until the next Put() or Clear() call.
+    const TValue* Get(const TKey& key)
+    {
+        auto it = Index.find(key);
+        if (it == Index.end()) {
+            return nullptr;
+        }
+        Items.splice(Items.begin(), Items, it->second);
+        return &it->second->Value;
+    }
+
+    void Put(const TKey& key, TValue value, size_t cost = 1)
+    {
+        Remove(key);
+        if (cost > Capacity) {
+            return;
+        }
+        Items.push_front(TItem{key, std::move(value), cost});
+        Index.emplace(key, Items.begin());
+        TotalCost += cost;
+        while (TotalCost > Capacity) {
+            Remove(Items.back().Key);
+        }
+    }
+
+    void Remove(const TKey& key)
+    {
+        auto it = Index.find(key);
+        if (it != Index.end()) {
+            TotalCost -= it->second->Cost;
+            Items.erase(it->second);
+            Index.erase(it);
+        }
+    }
+
+    void Clear()
+    {
+        Index.clear();
+        Items.clear();
+        TotalCost = 0;
+    }
+
+private:
+    struct TItem
+    {
+        TKey Key;
+        TValue Value;
+        size_t Cost;
+    };
+
+    size_t Capacity;
+    size_t TotalCost;
+    std::list<TItem> Items;
+    std::unordered_map<TKey, typename std::list<TItem>::iterator> Index;
+};
@@ -0,0 +1,327 @@
+#include "message_matcher.h"
+
+#include "regex_literals.h"
+#include "text_search.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using icu::RegexPattern;
+using icu::StringPiece;
+using icu::UnicodeString;
+
+namespace
+{
+    const size_t MAX_MATCH_SPANS = 100;
+}
+
+TRegexEngine GetRegexEngine(const std::string& name)
+{
+    // RE2 results differ from ICU in many details, so it is used only if requested explicitly
+    if (name.empty() || name == "icu" || name == "auto") {
+        return TRegexEngine::Icu;
+    }
+    if (name == "re2") {
+        return TRegexEngine::Re2;
+    }
+    throw std::runtime_error("Unknown regex engine '" + name + "'");
+}
+
+TRegexCache::TRegexCache(size_t capacity): Cache(capacity), Re2Cache(capacity)
+{}
+
+std::shared_ptr<const RegexPattern> TRegexCache::Get(const std::string& pattern, bool caseSensitive)
+{
+    auto key = (caseSensitive ? "s:" : "i:") + pattern;
+    {
+        std::unique_lock<std::mutex> lk(Mutex);
+        auto res = Cache.Get(key);
+        if (res) {
+            return *res;
+        }
+    }
+    UErrorCode status = U_ZERO_ERROR;
+    std::shared_ptr<const RegexPattern> res(RegexPattern::compile(UnicodeString::fromUTF8(pattern),
+                                                                  (caseSensitive ? 0 : UREGEX_CASE_INSENSITIVE),
+                                                                  status));
+    if (U_FAILURE(status)) {
+        throw std::runtime_error(std::string("Invalid regular expression: ") + u_errorName(status));
+    }
+    std::unique_lock<std::mutex> lk(Mutex);
+    Cache.Put(key, res);
+    return res;
+}
+
+std::shared_ptr<const re2::RE2> TRegexCache::GetRe2(const std::string& pattern,
+                                                    bool caseSensitive,
+                                                    std::string& error)
+{
+    auto key = (caseSensitive ? "s:" : "i:") + pattern;
+    {
+        std::unique_lock<std::mutex> lk(Mutex);
+        auto res = Re2Cache.Get(key);
+        if (res) {
+            return *res;
+        }
+    }
+    re2::RE2::Options options;
+    options.set_case_sensitive(caseSensitive);
+    options.set_never_capture(true);
+    options.set_log_errors(false);
+    auto res = std::make_shared<const re2::RE2>(pattern, options);
+    if (!res->ok()) {
+        error = res->error();
+        return nullptr;
+    }
+    std::unique_lock<std::mutex> lk(Mutex);
+    Re2Cache.Put(key, res);
+    return res;
+}
+
+TMessageMatcher::TMessageMatcher(const std::string& pattern,
+                                 bool caseSensitive,
+                                 bool regEx,
+                                 TRegexCache& regexCache,
+                                 TRegexEngine regexEngine)
+    : Pattern(UnicodeString::fromUTF8(pattern)),
+      CaseSensitive(caseSensitive)
+{
+    if (Pattern.isEmpty()) {
+        return;
+    }
+    if (regEx) {
+        if (regexEngine == TRegexEngine::Re2) {
+            std::string error;
+            Re2 = regexCache.GetRe2(pattern, caseSensitive, error);
+            if (!Re2) {
+                throw std::runtime_error("Invalid regular expression: " + error);
+            }
+        } else {
+            UErrorCode status = U_ZERO_ERROR;
+            IcuPattern = regexCache.Get(pattern, caseSensitive);
+            Regex.reset(IcuPattern->matcher(status));
+            if (U_FAILURE(status)) {
+                throw std::runtime_error("Could not create a RegexMatcher object");
+            }
+        }
+        for (auto& literal: GetRequiredLiterals(pattern)) {
+            if (caseSensitive) {
+                RegexLiterals.push_back(literal);
+            } else if (IsAscii(literal.data(), literal.size())) {
+                std::transform(literal.begin(), literal.end(), literal.begin(), ::tolower);
+                RegexLiterals.push_back(literal);
+            }
+        }
+    } else if (CaseSensitive) {
+        Utf8Pattern = pattern;
+    } else {
+        Pattern.foldCase();
+        if (IsAscii(pattern.data(), pattern.size())) {
+            Pattern.toUTF8String(Utf8Pattern);
+        }
+    }
+}
+
+bool TMessageMatcher::IsEmpty() const
+{
+    return Pattern.isEmpty() && !Query;
+}
+
+void TMessageMatcher::SetQuery(const std::string& query)
+{
+    Query = std::make_shared<const TBooleanQuery>(query, CaseSensitive);
+}
+
+bool TMessageMatcher::Match(const char* msg, size_t size)
+{
+    Interrupted = false;
+    Spans.clear();
+    if (Query && !Query->Match(msg, size)) {
+        return false;
+    }
+    if (Pattern.isEmpty()) {
+        return true;
+    }
+    if (Re2) {
+        return MayMatchRegex(msg, size) && MatchesRe2(msg, size);
+    }
+    if (Regex) {
+        return MayMatchRegex(msg, size) && MatchesRegex(msg, size);
+    }
+    if (!Utf8Pattern.empty()) {
+        auto found = CaseSensitive ? FindSubstring(msg, size, Utf8Pattern.data(), Utf8Pattern.size())
+                                   : FindSubstringIgnoreAsciiCase(msg, size, Utf8Pattern.data(), Utf8Pattern.size());
+        if (found != nullptr) {
+            if (CollectSpans) {
+                AddSubstringSpans(msg, size, found);
+            }
+            return true;
+        }
+        // Some non-ASCII characters are folded to ASCII ones, e.g. KELVIN SIGN to 'k'
+        if (CaseSensitive || !HasAsciiFoldableChars(msg, size)) {
+            return false;
+        }
+    }
+    return HasSubstring(msg, size);
+}
+
+void TMessageMatcher::AddSubstringSpans(const char* msg, size_t size, const char* found)
+{
+    while (found != nullptr && Spans.size() < MAX_MATCH_SPANS) {
+        size_t begin = found - msg;
+        size_t end = begin + Utf8Pattern.size();
+        Spans.push_back({begin, end});
+        found = CaseSensitive
+                    ? FindSubstring(msg + end, size - end, Utf8Pattern.data(), Utf8Pattern.size())
+                    : FindSubstringIgnoreAsciiCase(msg + end, size - end, Utf8Pattern.data(), Utf8Pattern.size());
+    }
+    ConvertSpans(msg, size, Spans, TSpanUnits::Bytes, SpanUnits);
+}
+
+bool TMessageMatcher::HasSubstring(const char* msg, size_t size)
+{
+    auto text = UnicodeString::fromUTF8(StringPiece(msg, size));
+    if (!CollectSpans) {
+        if (CaseSensitive) {
+            return (text.indexOf(Pattern) >= 0);
+        }
+        return (UnicodeString(text).foldCase().indexOf(Pattern) >= 0);
+    }
+
+    // Case folding can change length of a text, so every character is folded separately
+    // to map positions in the folded text to the original one
+    UnicodeString folded;
+    std::vector<int32_t> origins;
+    for (int32_t i = 0; i < text.length();) {
+        auto len = U16_LENGTH(text.char32At(i));
+        UnicodeString c(text, i, len);
+        if (!CaseSensitive) {
+            c.foldCase();
+        }
+        folded.append(c);
+        origins.insert(origins.end(), c.length(), i);
+        i += len;
+    }
+    for (auto pos = folded.indexOf(Pattern); pos >= 0 && Spans.size() < MAX_MATCH_SPANS;
+         pos = folded.indexOf(Pattern, pos + Pattern.length()))
+    {
+        auto last = origins[pos + Pattern.length() - 1];
+        Spans.push_back({size_t(origins[pos]), size_t(last + U16_LENGTH(text.char32At(last)))});
+    }
+    ConvertSpans(msg, size, Spans, TSpanUnits::Utf16, SpanUnits);
+    return !Spans.empty();
+}
+
+bool TMessageMatcher::MayMatchRegex(const char* msg, size_t size) const
+{
+    for (const auto& literal: RegexLiterals) {
+        if (CaseSensitive) {
+            if (FindSubstring(msg, size, literal.data(), literal.size()) == nullptr) {
+                return false;
+            }
+        } else if (FindSubstringIgnoreAsciiCase(msg, size, literal.data(), literal.size()) == nullptr) {
+            // Some non-ASCII characters are folded to ASCII ones
+            return HasAsciiFoldableChars(msg, size);
+        }
+    }
+    return true;
+}
+
+void TMessageMatcher::SetDeadline(std::chrono::steady_clock::time_point deadline, const std::atomic_bool* cancelled)
+{
+    if (Limits) {
+        Limits->Deadline = deadline;
+        Limits->Cancelled = cancelled;
+        return;
+    }
+    Limits.reset(new TMatchLimits{deadline, cancelled});
+    if (Regex) {
+        UErrorCode status = U_ZERO_ERROR;
+        Regex->setMatchCallback(&TMessageMatcher::OnMatchProgress, Limits.get(), status);
+        if (U_FAILURE(status)) {
+            throw std::runtime_error(std::string("Failed to set regex match callback: ") + u_errorName(status));
+        }
+    }
+}
+
+bool TMessageMatcher::IsInterrupted() const
+{
+    return Interrupted;
+}
+
+UBool U_CALLCONV TMessageMatcher::OnMatchProgress(const void* context, int32_t /*steps*/)
+{
+    auto limits = static_cast<const TMatchLimits*>(context);
+    if (limits->Cancelled && *limits->Cancelled) {
+        return false;
+    }
+    return std::chrono::steady_clock::now() < limits->Deadline;
+}
+
+bool TMessageMatcher::MatchesRegex(const char* msg, size_t size)
+{
+    // The matcher keeps a reference to the text
+    auto text = UnicodeString::fromUTF8(StringPiece(msg, size));
+    UErrorCode status = U_ZERO_ERROR;
+    Regex->reset(text);
+    bool ok = Regex->find(status);
+    Interrupted = (status == U_REGEX_STOPPED_BY_CALLER);
+    if (Interrupted) {
+        return false;
+    }
+    if (U_FAILURE(status)) {
+        throw std::runtime_error("Error searching for pattern");
+    }
+    if (ok && CollectSpans) {
+        // Errors and interruption of following searches don't change the result
+        do {
+            auto begin = Regex->start(status);
+            auto end = Regex->end(status);
+            if (U_SUCCESS(status) && end > begin) {
+                Spans.push_back({size_t(begin), size_t(end)});
+            }
+        } while (Spans.size() < MAX_MATCH_SPANS && Regex->find(status));
+        ConvertSpans(msg, size, Spans, TSpanUnits::Utf16, SpanUnits);
+    }
+    return ok;
+}
+
+bool TMessageMatcher::MatchesRe2(const char* msg, size_t size)
+{
+    re2::StringPiece text(msg, size);
+    if (!CollectSpans) {
+        return re2::RE2::PartialMatch(text, *Re2);
+    }
+    bool ok = false;
+    re2::StringPiece match;
+    size_t pos = 0;
+    while (pos <= size && Spans.size() < MAX_MATCH_SPANS &&
+           Re2->Match(text, pos, size, re2::RE2::UNANCHORED, &match, 1))
+    {
+        ok = true;
+        size_t begin = match.data() - msg;
+        pos = begin + match.size();
+        if (match.empty()) {
+            // Skip a character after an empty match
+            ++pos;
+            while (pos < size && (static_cast<unsigned char>(msg[pos]) & 0xC0) == 0x80) {
+                ++pos;
+            }
+        } else {
+            Spans.push_back({begin, pos});
+        }
+    }
+    ConvertSpans(msg, size, Spans, TSpanUnits::Bytes, SpanUnits);
+    return ok;
+}
+
+void TMessageMatcher::EnableSpans(TSpanUnits units)
+{
+    CollectSpans = true;
+    SpanUnits = units;
+}
+
+const std::vector<TMatchSpan>& TMessageMatcher::GetSpans() const
+{
+    return Spans;
+}
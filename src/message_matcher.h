@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <re2/re2.h>
+#include <unicode/regex.h>
+#include <unicode/unistr.h>
+
+#include "boolean_query.h"
+#include "log_entry.h"
+#include "lru_cache.h"
+
+//! Regular expressions engine
+enum class TRegexEngine
+{
+    //! ICU, backtracking matcher, the default
+    Icu,
+
+    //! RE2, linear matching time, no backreferences and lookarounds.
+    //! Results differ from ICU: \w, \b, \d, \s are ASCII-only, "." matches "\r", "$" doesn't match before "\n",
+    //! case-insensitive matching uses simple case folding, nested character classes are not supported
+    Re2
+};
+
+//! Converts "regex-engine" request param value, throws std::runtime_error if the value is unknown.
+//! "auto" is accepted for compatibility and selects ICU
+TRegexEngine GetRegexEngine(const std::string& name);
+
+//! Thread-safe cache of compiled regular expressions.
+//! Web UI sends the same pattern for every page of a log, so it is compiled only once.
+class TRegexCache
+{
+public:
+    explicit TRegexCache(size_t capacity);
+
+    std::shared_ptr<const icu::RegexPattern> Get(const std::string& pattern, bool caseSensitive);
+
+    //! Returns nullptr and sets error if RE2 doesn't support the pattern
+    std::shared_ptr<const re2::RE2> GetRe2(const std::string& pattern, bool caseSensitive, std::string& error);
+
+private:
+    std::mutex Mutex;
+    TLruCache<std::string, std::shared_ptr<const icu::RegexPattern>> Cache;
+    TLruCache<std::string, std::shared_ptr<const re2::RE2>> Re2Cache;
+};
+
+//! Search pattern compiled once per request.
+//! The object is not thread-safe, it holds a reusable regex matcher.
+class TMessageMatcher
+{
+public:
+    //! Creates a matcher accepting all messages
+    TMessageMatcher() = default;
+
+    TMessageMatcher(const std::string& pattern,
+                    bool caseSensitive,
+                    bool regEx,
+                    TRegexCache& regexCache,
+                    TRegexEngine regexEngine = TRegexEngine::Icu);
+
+    //! Returns true if there is no pattern and query, all messages are accepted
+    bool IsEmpty() const;
+
+    //! Sets a boolean query, which must match in addition to the pattern.
+    //! Case sensitivity is the same as for the pattern. Throws std::runtime_error on syntax errors
+    void SetQuery(const std::string& query);
+
+    /**
+     * @brief Checks if a message matches the pattern
+     *
+     * @param msg UTF-8 encoded message
+     * @param size message size in bytes
+     */
+    bool Match(const char* msg, size_t size);
+
+    //! Sets time after which ICU regex matching of a message is interrupted, cancelled flag is checked too.
+    //! RE2 and substring search are linear and are not interrupted
+    void SetDeadline(std::chrono::steady_clock::time_point deadline, const std::atomic_bool* cancelled = nullptr);
+
+    //! Returns true if the last Match() call was interrupted, the message is treated as not matching
+    bool IsInterrupted() const;
+
+    //! Enables collecting of message parts matching the pattern during Match() calls
+    void EnableSpans(TSpanUnits units);
+
+    //! Returns message parts matching the pattern found by the last successful Match() call.
+    //! Empty if spans are not enabled or there is no pattern, query terms are not included
+    const std::vector<TMatchSpan>& GetSpans() const;
+
+private:
+    struct TMatchLimits
+    {
+        std::chrono::steady_clock::time_point Deadline;
+        const std::atomic_bool* Cancelled;
+    };
+
+    static UBool U_CALLCONV OnMatchProgress(const void* context, int32_t steps);
+
+    bool HasSubstring(const char* msg, size_t size);
+    bool MatchesRegex(const char* msg, size_t size);
+    bool MatchesRe2(const char* msg, size_t size);
+
+    //! Adds spans of all occurrences of Utf8Pattern starting from the found one
+    void AddSubstringSpans(const char* msg, size_t size, const char* found);
+
+    //! Returns false if the message surely doesn't contain literals required by the regex
+    bool MayMatchRegex(const char* msg, size_t size) const;
+
+    icu::UnicodeString Pattern;
+    bool CaseSensitive = true;
+    //! RegexMatcher doesn't own its pattern, so the pattern is kept while the cache can evict it
+    std::shared_ptr<const icu::RegexPattern> IcuPattern;
+    std::unique_ptr<icu::RegexMatcher> Regex;
+    std::shared_ptr<const re2::RE2> Re2;
+    std::shared_ptr<const TBooleanQuery> Query;
+
+    //! UTF-8 pattern for byte-level search, lowercase for case-insensitive search.
+    //! Empty if the pattern needs Unicode case folding
+    std::string Utf8Pattern;
+
+    //! UTF-8 literals which must be present in messages matching the regex, lowercase ASCII for case-insensitive regex
+    std::vector<std::string> RegexLiterals;
+
+    // Allocated separately, so ICU callback context stays valid when the matcher is moved
+    std::unique_ptr<TMatchLimits> Limits;
+    bool Interrupted = false;
+
+    bool CollectSpans = false;
+    TSpanUnits SpanUnits = TSpanUnits::Utf8;
+    std::vector<TMatchSpan> Spans;
+};
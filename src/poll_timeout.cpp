@@ -0,0 +1,14 @@
+#include "poll_timeout.h"
+
+#include <time.h>
+
+int GetPollTimeout(uint64_t usec)
+{
+    if (usec == UINT64_MAX) {
+        return -1;
+    }
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    return (usec > now) ? (usec - now + 999) / 1000 : 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+//! Converts an absolute CLOCK_MONOTONIC time in microseconds returned by sd_journal_get_timeout()
+//! or sd_bus_get_timeout() to poll() timeout in milliseconds. UINT64_MAX means no timeout
+int GetPollTimeout(uint64_t usec);
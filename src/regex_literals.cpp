@@ -0,0 +1,179 @@
+#include "regex_literals.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const size_t MAX_LITERALS = 4;
+
+    // Escapes of character classes and assertions without arguments
+    const char* CLASS_ESCAPES = "dDwWsSbBAzZGhHvVRX";
+
+    bool IsUtf8Continuation(char c)
+    {
+        return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+    }
+
+    //! Removes the last UTF-8 character
+    void PopChar(std::string& str)
+    {
+        while (!str.empty() && IsUtf8Continuation(str.back())) {
+            str.pop_back();
+        }
+        if (!str.empty()) {
+            str.pop_back();
+        }
+    }
+
+    //! Returns position after a set expression starting at pos or npos if it is not closed
+    size_t SkipSet(const std::string& pattern, size_t pos)
+    {
+        int depth = 0;
+        for (; pos < pattern.size(); ++pos) {
+            switch (pattern[pos]) {
+                case '\\':
+                    ++pos;
+                    break;
+                case '[':
+                    ++depth;
+                    break;
+                case ']':
+                    if (--depth == 0) {
+                        return pos + 1;
+                    }
+                    break;
+            }
+        }
+        return std::string::npos;
+    }
+
+    //! Returns position after a group starting at pos or npos if it is not closed
+    size_t SkipGroup(const std::string& pattern, size_t pos)
+    {
+        int depth = 0;
+        while (pos < pattern.size()) {
+            switch (pattern[pos]) {
+                case '\\':
+                    pos += 2;
+                    continue;
+                case '[':
+                    pos = SkipSet(pattern, pos);
+                    if (pos == std::string::npos) {
+                        return pos;
+                    }
+                    continue;
+                case '(':
+                    ++depth;
+                    break;
+                case ')':
+                    if (--depth == 0) {
+                        return pos + 1;
+                    }
+                    break;
+            }
+            ++pos;
+        }
+        return std::string::npos;
+    }
+}
+
+std::vector<std::string> GetRequiredLiterals(const std::string& pattern)
+{
+    std::vector<std::string> literals;
+    std::string current;
+    auto endLiteral = [&]() {
+        if (!current.empty()) {
+            literals.push_back(current);
+            current.clear();
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        char c = pattern[pos];
+        switch (c) {
+            case '|':
+                // Any branch can match, no literal is required
+                return {};
+            case ')':
+                return {};
+            case '.':
+            case '^':
+            case '$':
+                endLiteral();
+                ++pos;
+                break;
+            case '[':
+                endLiteral();
+                pos = SkipSet(pattern, pos);
+                if (pos == std::string::npos) {
+                    return {};
+                }
+                break;
+            case '(':
+                // Inline flags like (?i) change matching of the rest of the pattern
+                if (pos + 2 < pattern.size() && pattern[pos + 1] == '?' && !strchr(":=!<>", pattern[pos + 2])) {
+                    return {};
+                }
+                endLiteral();
+                pos = SkipGroup(pattern, pos);
+                if (pos == std::string::npos) {
+                    return {};
+                }
+                break;
+            case '*':
+            case '?':
+            case '{':
+                // The previous character is optional
+                PopChar(current);
+                endLiteral();
+                pos = (c == '{') ? pattern.find('}', pos) : pos;
+                if (pos == std::string::npos) {
+                    return {};
+                }
+                ++pos;
+                break;
+            case '+':
+                // The previous character is required, but the following text may be separated by its repetitions
+                endLiteral();
+                ++pos;
+                break;
+            case '\\': {
+                if (pos + 1 >= pattern.size()) {
+                    return {};
+                }
+                char e = pattern[pos + 1];
+                if (isalnum(static_cast<unsigned char>(e))) {
+                    if (!strchr(CLASS_ESCAPES, e)) {
+                        return {};
+                    }
+                    endLiteral();
+                } else {
+                    current += e;
+                }
+                pos += 2;
+                break;
+            }
+            default:
+                current += c;
+                ++pos;
+                break;
+        }
+        // Lazy and possessive quantifier modifiers
+        if ((c == '*' || c == '+' || c == '?' || c == '{') && pos < pattern.size() &&
+            (pattern[pos] == '?' || pattern[pos] == '+'))
+        {
+            ++pos;
+        }
+    }
+    endLiteral();
+
+    std::stable_sort(literals.begin(), literals.end(), [](const std::string& a, const std::string& b) {
+        return a.size() > b.size();
+    });
+    if (literals.size() > MAX_LITERALS) {
+        literals.resize(MAX_LITERALS);
+    }
+    return literals;
+}
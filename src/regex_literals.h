@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Extracts literal substrings which must be present in any text matching an ICU regular expression.
+ *
+ * The analysis is conservative: patterns with top-level alternation, inline flags
+ * or unknown escape sequences give no literals. Literals are sorted from the longest one.
+ */
+std::vector<std::string> GetRequiredLiterals(const std::string& pattern);
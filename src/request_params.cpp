@@ -0,0 +1,41 @@
+#include "request_params.h"
+
+#include <stdexcept>
+
+#include <syslog.h>
+
+std::set<int> GetLevels(const Json::Value& params)
+{
+    std::set<int> levels;
+    for (const auto& lv: params["levels"]) {
+        if (lv.isInt()) {
+            int l = lv.asInt();
+            if (l >= LOG_EMERG && l <= LOG_DEBUG) {
+                levels.insert(l);
+            }
+        }
+    }
+    return levels;
+}
+
+TMessageMatcher MakeMatcher(const Json::Value& params, TRegexCache& regexCache)
+{
+    TMessageMatcher res(params.get("pattern", "").asString(),
+                        params.get("case-sensitive", true).asBool(),
+                        params.get("regex", false).asBool(),
+                        regexCache,
+                        GetRegexEngine(params.get("regex-engine", "").asString()));
+    auto query = params.get("query", "").asString();
+    if (!query.empty()) {
+        res.SetQuery(query);
+    }
+    auto spans = params.get("match-spans", "").asString();
+    if (spans == "utf8") {
+        res.EnableSpans(TSpanUnits::Utf8);
+    } else if (spans == "utf16") {
+        res.EnableSpans(TSpanUnits::Utf16);
+    } else if (!spans.empty()) {
+        throw std::runtime_error("Unknown match-spans value '" + spans + "'");
+    }
+    return res;
+}
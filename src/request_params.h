@@ -0,0 +1,16 @@
+#pragma once
+
+#include <set>
+
+#include <wblib/json_utils.h>
+
+#include "message_matcher.h"
+
+// Parsing of entries filter params shared by Load and Follow requests
+
+//! Returns valid levels from "levels" request param
+std::set<int> GetLevels(const Json::Value& params);
+
+//! Makes a matcher from "pattern", "case-sensitive", "regex", "regex-engine", "query" and "match-spans" params.
+//! Throws std::runtime_error on invalid params
+TMessageMatcher MakeMatcher(const Json::Value& params, TRegexCache& regexCache);
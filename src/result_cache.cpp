@@ -0,0 +1,32 @@
+#include "result_cache.h"
+
+TResultCache::TResultCache(size_t maxSize): Cache(maxSize), JournalHead(0)
+{}
+
+bool TResultCache::Get(const std::string& key, Json::Value& result)
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    auto res = Cache.Get(key);
+    if (res) {
+        result = *res;
+    }
+    return res != nullptr;
+}
+
+void TResultCache::Put(const std::string& key, const Json::Value& result)
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    auto cost = key.size() + Json::writeString(builder, result).size();
+    std::unique_lock<std::mutex> lk(Mutex);
+    Cache.Put(key, result, cost);
+}
+
+void TResultCache::SetJournalHead(uint64_t head)
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    if (head != JournalHead) {
+        Cache.Clear();
+        JournalHead = head;
+    }
+}
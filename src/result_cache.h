@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include <wblib/json_utils.h>
+
+#include "lru_cache.h"
+
+//! Cache of Load results bounded by the total size of serialized results.
+//! All results are dropped when old journal entries are removed.
+class TResultCache
+{
+public:
+    explicit TResultCache(size_t maxSize);
+
+    //! Returns true and sets result if there is a cached result for the key
+    bool Get(const std::string& key, Json::Value& result);
+
+    void Put(const std::string& key, const Json::Value& result);
+
+    //! Drops cached results if the timestamp of the oldest journal entry is changed by vacuuming
+    void SetJournalHead(uint64_t head);
+
+private:
+    std::mutex Mutex;
+    TLruCache<std::string, Json::Value> Cache;
+    uint64_t JournalHead;
+};
@@ -0,0 +1,78 @@
+#include "result_stream.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace WBMQTT;
+
+namespace
+{
+    const auto STREAM_TOPIC_PREFIX = "/wb_logs/stream/";
+    const size_t STREAM_CHUNK_SIZE = 20;
+    const std::string CHUNK_PREFIX = "{\"entries\":[";
+    const std::string CHUNK_SUFFIX = "]}";
+    const auto STREAM_FLUSH_INTERVAL = std::chrono::milliseconds(100);
+    const size_t MAX_TOPIC_ID_LENGTH = 64;
+}
+
+bool IsValidTopicId(const std::string& id)
+{
+    return !id.empty() && id.size() <= MAX_TOPIC_ID_LENGTH &&
+           std::all_of(id.begin(), id.end(), [](char c) { return isalnum(c) || c == '-' || c == '_'; });
+}
+
+TResultStream::TResultStream(PMqttClient mqttClient, const std::string& id)
+    : MqttClient(mqttClient),
+      Topic(STREAM_TOPIC_PREFIX + id),
+      Chunk(CHUNK_PREFIX),
+      ChunkSize(0),
+      FirstChunkSent(false),
+      LastFlushTime(std::chrono::steady_clock::now())
+{
+    if (!IsValidTopicId(id)) {
+        throw std::runtime_error("Invalid stream id '" + id + "'");
+    }
+}
+
+void TResultStream::Add(TLogEntry& entry)
+{
+    if (ChunkSize) {
+        Chunk += ',';
+    }
+    AppendJson(Chunk, entry);
+    ++ChunkSize;
+    // The first entry is sent immediately to show something as soon as possible
+    if (!FirstChunkSent || ChunkSize >= STREAM_CHUNK_SIZE ||
+        std::chrono::steady_clock::now() - LastFlushTime >= STREAM_FLUSH_INTERVAL)
+    {
+        Flush();
+    }
+}
+
+Json::Value TResultStream::Finish(Json::Value stats)
+{
+    Flush();
+    stats["done"] = true;
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    Publish(Json::writeString(builder, stats));
+    return stats;
+}
+
+void TResultStream::Flush()
+{
+    if (ChunkSize == 0) {
+        return;
+    }
+    Chunk += CHUNK_SUFFIX;
+    Publish(Chunk);
+    Chunk = CHUNK_PREFIX;
+    ChunkSize = 0;
+    FirstChunkSent = true;
+    LastFlushTime = std::chrono::steady_clock::now();
+}
+
+void TResultStream::Publish(const std::string& payload)
+{
+    MqttClient->Publish(TMqttMessage(Topic, payload, 1, false));
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include <wblib/mqtt.h>
+
+#include "log_entry.h"
+
+//! Publishes Load results to a MQTT topic in chunks while they are being read.
+//! The last message is a "done" frame with request statistics.
+class TResultStream
+{
+public:
+    TResultStream(WBMQTT::PMqttClient mqttClient, const std::string& id);
+
+    void Add(TLogEntry& entry);
+
+    //! Publishes remaining entries and "done" frame made from stats. Returns the "done" frame
+    Json::Value Finish(Json::Value stats);
+
+private:
+    void Flush();
+    void Publish(const std::string& payload);
+
+    WBMQTT::PMqttClient MqttClient;
+    std::string Topic;
+
+    //! Serialized frame with entries of current chunk
+    std::string Chunk;
+    size_t ChunkSize;
+    bool FirstChunkSent;
+    std::chrono::steady_clock::time_point LastFlushTime;
+};
+
+//! Checks if id can be used as a MQTT topic level
+bool IsValidTopicId(const std::string& id);
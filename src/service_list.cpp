@@ -0,0 +1,243 @@
+#include "service_list.h"
+
+#include "log.h"
+#include "poll_timeout.h"
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wblib/utils.h>
+
+#define LOG(logger) ::logger.Log() << "[services] "
+
+namespace
+{
+    const auto SYSTEMD_SERVICE = "org.freedesktop.systemd1";
+    const auto SYSTEMD_PATH = "/org/freedesktop/systemd1";
+    const auto SYSTEMD_MANAGER_INTERFACE = "org.freedesktop.systemd1.Manager";
+    const auto SERVICE_PATTERN = "*.service";
+    const int RECONNECT_INTERVAL_MS = 5000;
+
+    //! Converts sd_bus_get_timeout() result to poll() timeout
+    int GetBusPollTimeout(sd_bus* bus)
+    {
+        uint64_t t;
+        if (sd_bus_get_timeout(bus, &t) < 0) {
+            return -1;
+        }
+        return GetPollTimeout(t);
+    }
+
+    std::set<std::string> GetUnitFiles(sd_bus* bus)
+    {
+        sd_bus_error error = SD_BUS_ERROR_NULL;
+        sd_bus_message* reply = nullptr;
+        // No unit file states to filter by and a single pattern
+        int r = sd_bus_call_method(bus,
+                                   SYSTEMD_SERVICE,
+                                   SYSTEMD_PATH,
+                                   SYSTEMD_MANAGER_INTERFACE,
+                                   "ListUnitFilesByPatterns",
+                                   &error,
+                                   &reply,
+                                   "asas",
+                                   0,
+                                   1,
+                                   SERVICE_PATTERN);
+        if (r < 0) {
+            std::string msg(error.message ? error.message : strerror(-r));
+            sd_bus_error_free(&error);
+            throw std::runtime_error("Failed to list unit files: " + msg);
+        }
+        std::unique_ptr<sd_bus_message, decltype(&sd_bus_message_unref)> replyPtr(reply, &sd_bus_message_unref);
+
+        std::set<std::string> res;
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ss)");
+        const char* path;
+        const char* state;
+        while (r >= 0 && (r = sd_bus_message_read(reply, "(ss)", &path, &state)) > 0) {
+            auto name = strrchr(path, '/');
+            res.insert(name ? name + 1 : path);
+        }
+        if (r < 0) {
+            throw std::runtime_error(std::string("Failed to parse unit files list: ") + strerror(-r));
+        }
+        return res;
+    }
+}
+
+TServiceList::TServiceList()
+    : Bus(nullptr),
+      List(Json::arrayValue),
+      Dirty(false),
+      Stopped(false),
+      WakeupFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (WakeupFd < 0) {
+        throw std::runtime_error(std::string("Failed to create eventfd: ") + strerror(errno));
+    }
+    if (Connect()) {
+        try {
+            Update();
+        } catch (const std::exception& e) {
+            LOG(Error) << e.what();
+        }
+    }
+    Thread = std::thread([this] { Run(); });
+}
+
+TServiceList::~TServiceList()
+{
+    Stopped = true;
+    uint64_t v = 1;
+    if (write(WakeupFd, &v, sizeof(v)) < 0) {
+        LOG(Error) << "Failed to wake up bus thread: " << strerror(errno);
+    }
+    if (Thread.joinable()) {
+        Thread.join();
+    }
+    Disconnect();
+    close(WakeupFd);
+}
+
+bool TServiceList::Connect()
+{
+    int r = sd_bus_open_system(&Bus);
+    if (r < 0) {
+        LOG(Error) << "Failed to connect to system bus: " << strerror(-r);
+        Bus = nullptr;
+        return false;
+    }
+    r = sd_bus_match_signal(Bus,
+                            nullptr,
+                            SYSTEMD_SERVICE,
+                            SYSTEMD_PATH,
+                            SYSTEMD_MANAGER_INTERFACE,
+                            "UnitFilesChanged",
+                            &TServiceList::OnUnitFilesChanged,
+                            this);
+    if (r >= 0) {
+        r = sd_bus_match_signal(Bus,
+                                nullptr,
+                                SYSTEMD_SERVICE,
+                                SYSTEMD_PATH,
+                                SYSTEMD_MANAGER_INTERFACE,
+                                "Reloading",
+                                &TServiceList::OnReloading,
+                                this);
+    }
+    if (r < 0) {
+        LOG(Error) << "Failed to watch unit files changes: " << strerror(-r);
+        Disconnect();
+        return false;
+    }
+    // systemd sends the signals only while some client is subscribed.
+    // The subscription is dropped when the connection is closed
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    r = sd_bus_call_method(Bus,
+                           SYSTEMD_SERVICE,
+                           SYSTEMD_PATH,
+                           SYSTEMD_MANAGER_INTERFACE,
+                           "Subscribe",
+                           &error,
+                           nullptr,
+                           "");
+    if (r < 0) {
+        LOG(Error) << "Failed to subscribe to systemd signals: " << (error.message ? error.message : strerror(-r));
+        sd_bus_error_free(&error);
+        Disconnect();
+        return false;
+    }
+    return true;
+}
+
+void TServiceList::Disconnect()
+{
+    if (Bus) {
+        sd_bus_flush_close_unref(Bus);
+        Bus = nullptr;
+    }
+}
+
+Json::Value TServiceList::Get()
+{
+    std::unique_lock<std::mutex> lk(Mutex);
+    return List;
+}
+
+int TServiceList::OnUnitFilesChanged(sd_bus_message* /*m*/, void* userdata, sd_bus_error* /*error*/)
+{
+    static_cast<TServiceList*>(userdata)->Dirty = true;
+    return 0;
+}
+
+int TServiceList::OnReloading(sd_bus_message* m, void* userdata, sd_bus_error* /*error*/)
+{
+    // The signal is sent with true before reloading and with false after it
+    int active = 0;
+    if (sd_bus_message_read(m, "b", &active) >= 0 && !active) {
+        static_cast<TServiceList*>(userdata)->Dirty = true;
+    }
+    return 0;
+}
+
+void TServiceList::Run()
+{
+    WBMQTT::SetThreadName("wb-logs services");
+    while (!Stopped) {
+        if (!Bus) {
+            pollfd fd = {WakeupFd, POLLIN, 0};
+            if (poll(&fd, 1, RECONNECT_INTERVAL_MS) < 0 && errno != EINTR) {
+                LOG(Error) << "Failed to wait for reconnection: " << strerror(errno);
+                break;
+            }
+            // Unit files could be changed while the connection was lost
+            if (!Stopped && Connect()) {
+                Dirty = true;
+            }
+            continue;
+        }
+        int r = sd_bus_process(Bus, nullptr);
+        if (r < 0) {
+            LOG(Error) << "Failed to process bus messages: " << strerror(-r);
+            Disconnect();
+            continue;
+        }
+        if (r > 0) {
+            continue;
+        }
+        // All queued signals are processed, so a burst of changes causes a single update
+        if (Dirty) {
+            Dirty = false;
+            try {
+                Update();
+            } catch (const std::exception& e) {
+                LOG(Error) << e.what();
+            }
+            continue;
+        }
+        pollfd fds[2] = {{sd_bus_get_fd(Bus), static_cast<short>(sd_bus_get_events(Bus)), 0},
+                         {WakeupFd, POLLIN, 0}};
+        if (poll(fds, 2, GetBusPollTimeout(Bus)) < 0 && errno != EINTR) {
+            LOG(Error) << "Failed to wait for bus messages: " << strerror(errno);
+            break;
+        }
+    }
+}
+
+void TServiceList::Update()
+{
+    Json::Value list(Json::arrayValue);
+    for (const auto& name: GetUnitFiles(Bus)) {
+        list.append(name);
+    }
+    std::unique_lock<std::mutex> lk(Mutex);
+    List.swap(list);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <systemd/sd-bus.h>
+#include <wblib/json_utils.h>
+
+/**
+ * @brief List of installed services.
+ *
+ * Unit files are requested from systemd over D-Bus and cached. The bus thread refreshes the list
+ * only when systemd reports unit files changes or configuration reloading,
+ * and reconnects to the bus if the connection is lost.
+ */
+class TServiceList
+{
+public:
+    TServiceList();
+    ~TServiceList();
+
+    TServiceList(const TServiceList&) = delete;
+    TServiceList& operator=(const TServiceList&) = delete;
+
+    //! Returns sorted names of services
+    Json::Value Get();
+
+private:
+    static int OnUnitFilesChanged(sd_bus_message* m, void* userdata, sd_bus_error* error);
+    static int OnReloading(sd_bus_message* m, void* userdata, sd_bus_error* error);
+
+    //! Connects to the system bus and subscribes to systemd signals, returns false on errors
+    bool Connect();
+    void Disconnect();
+
+    void Run();
+    void Update();
+
+    sd_bus* Bus;
+    std::mutex Mutex;
+    Json::Value List;
+    bool Dirty;
+
+    std::atomic_bool Stopped;
+    int WakeupFd;
+    std::thread Thread;
+};
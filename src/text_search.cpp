@@ -0,0 +1,114 @@
+#include "text_search.h"
+
+#include "text_search_kernel.h"
+
+#ifdef HAVE_NEON_DISPATCH
+#include <sys/auxv.h>
+#endif
+
+namespace
+{
+#ifdef HAVE_NEON_DISPATCH
+    // armhf baseline has no NEON, the kernels are built separately and used if the CPU supports them
+    const bool HAS_NEON = (getauxval(AT_HWCAP) & HWCAP_ARM_NEON) != 0;
+#endif
+
+    template<bool IgnoreCase>
+    const char* FindSubstringImpl(const char* text, size_t size, const char* pattern, size_t patternSize)
+    {
+#if defined(HAVE_SIMD_KERNEL)
+        return FindSubstringSimd<IgnoreCase>(text, size, pattern, patternSize);
+#elif defined(HAVE_NEON_DISPATCH)
+        if (HAS_NEON) {
+            return IgnoreCase ? FindSubstringIgnoreAsciiCaseNeon(text, size, pattern, patternSize)
+                              : FindSubstringNeon(text, size, pattern, patternSize);
+        }
+        return FindSubstringScalar<IgnoreCase>(text, size, pattern, patternSize);
+#else
+        return FindSubstringScalar<IgnoreCase>(text, size, pattern, patternSize);
+#endif
+    }
+}
+
+const char* FindSubstring(const char* text, size_t size, const char* pattern, size_t patternSize)
+{
+#if defined(HAVE_SIMD_KERNEL) || defined(HAVE_NEON_DISPATCH)
+    return FindSubstringImpl<false>(text, size, pattern, patternSize);
+#else
+    return static_cast<const char*>(memmem(text, size, pattern, patternSize));
+#endif
+}
+
+const char* FindSubstringIgnoreAsciiCase(const char* text, size_t size, const char* pattern, size_t patternSize)
+{
+    return FindSubstringImpl<true>(text, size, pattern, patternSize);
+}
+
+bool IsAscii(const char* text, size_t size)
+{
+    size_t i = 0;
+    // Check 8 bytes at once
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t v;
+        memcpy(&v, text + i, sizeof(v));
+        if (v & 0x8080808080808080ULL) {
+            return false;
+        }
+    }
+    for (; i < size; ++i) {
+        if (static_cast<unsigned char>(text[i]) >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HasAsciiFoldableChars(const char* text, size_t size)
+{
+    auto s = reinterpret_cast<const unsigned char*>(text);
+    for (size_t i = 0; i + 1 < size; ++i) {
+        // Lead bytes of the characters are 0xC3 and above, most Cyrillic text is skipped by the first check
+        if (s[i] < 0xC3) {
+            continue;
+        }
+        auto next = s[i + 1];
+        switch (s[i]) {
+            case 0xC3: // U+00DF ß
+                if (next == 0x9F) {
+                    return true;
+                }
+                break;
+            case 0xC4: // U+0130 İ
+                if (next == 0xB0) {
+                    return true;
+                }
+                break;
+            case 0xC5: // U+0149 ŉ, U+017F ſ
+                if (next == 0x89 || next == 0xBF) {
+                    return true;
+                }
+                break;
+            case 0xC7: // U+01F0 ǰ
+                if (next == 0xB0) {
+                    return true;
+                }
+                break;
+            case 0xE1: // U+1E96-U+1E9A ẖ-ẚ, U+1E9E ẞ
+                if (next == 0xBA && i + 2 < size && ((s[i + 2] >= 0x96 && s[i + 2] <= 0x9A) || s[i + 2] == 0x9E)) {
+                    return true;
+                }
+                break;
+            case 0xE2: // U+212A KELVIN SIGN
+                if (next == 0x84 && i + 2 < size && s[i + 2] == 0xAA) {
+                    return true;
+                }
+                break;
+            case 0xEF: // U+FB00-U+FB06 ligatures
+                if (next == 0xAC && i + 2 < size && s[i + 2] >= 0x80 && s[i + 2] <= 0x86) {
+                    return true;
+                }
+                break;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+// Byte-level search in UTF-8 encoded text.
+// A valid UTF-8 substring matches only at character boundaries, so no decoding is needed.
+
+//! Returns pointer to the first occurrence of a pattern or nullptr
+const char* FindSubstring(const char* text, size_t size, const char* pattern, size_t patternSize);
+
+//! Returns pointer to the first occurrence of a lowercase pattern ignoring case of ASCII letters or nullptr
+const char* FindSubstringIgnoreAsciiCase(const char* text, size_t size, const char* pattern, size_t patternSize);
+
+//! Returns true if all bytes are ASCII characters
+bool IsAscii(const char* text, size_t size);
+
+/**
+ * @brief Returns true if the text has non-ASCII characters folded to strings with ASCII letters.
+ *
+ * These are ß, İ, ŉ, ǰ, ſ, ẖ-ẚ, ẞ, KELVIN SIGN and ﬀ-ﬆ ligatures. Case-insensitive search
+ * of ASCII strings in other texts, including Cyrillic ones, needs only ASCII case folding.
+ */
+bool HasAsciiFoldableChars(const char* text, size_t size);
+
+#ifdef HAVE_NEON_DISPATCH
+// NEON kernels for armhf, built with NEON enabled and called only if the CPU supports it
+
+const char* FindSubstringNeon(const char* text, size_t size, const char* pattern, size_t patternSize);
+const char* FindSubstringIgnoreAsciiCaseNeon(const char* text, size_t size, const char* pattern, size_t patternSize);
+#endif
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Substring search kernels compare the first and the last pattern bytes with a block of text
+// at once and check the whole pattern only at positions where both bytes match.
+// See "SIMD-friendly algorithms for substring searching" by Wojciech Muła.
+//
+// The header is included by translation units compiled with different instruction sets,
+// so everything has internal linkage and the linker can't mix up the code.
+
+namespace
+{
+    inline char ToLowerAscii(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+
+    inline bool IsLowerAsciiLetter(char c)
+    {
+        return (c >= 'a' && c <= 'z');
+    }
+
+    //! Compares text with a lowercase pattern ignoring case of ASCII letters
+    inline bool EqualsIgnoreAsciiCase(const char* text, const char* pattern, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i) {
+            if (ToLowerAscii(text[i]) != pattern[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<bool IgnoreCase> bool EqualsPattern(const char* text, const char* pattern, size_t size)
+    {
+        return IgnoreCase ? EqualsIgnoreAsciiCase(text, pattern, size) : (memcmp(text, pattern, size) == 0);
+    }
+
+    template<bool IgnoreCase>
+    const char* FindSubstringScalar(const char* text, size_t size, const char* pattern, size_t patternSize)
+    {
+        if (size < patternSize) {
+            return nullptr;
+        }
+        auto last = text + size - patternSize;
+        for (auto p = text; p <= last; ++p) {
+            if (EqualsPattern<IgnoreCase>(p, pattern, patternSize)) {
+                return p;
+            }
+        }
+        return nullptr;
+    }
+
+    //! Text byte c matches a pattern byte if (c | FoldMask) == Value.
+    //! ASCII letters of a lowercase pattern match both cases if case is ignored
+    struct TByteMatcher
+    {
+        uint8_t Value;
+        uint8_t FoldMask;
+    };
+
+    inline TByteMatcher MakeByteMatcher(char c, bool ignoreCase)
+    {
+        return TByteMatcher{static_cast<uint8_t>(c),
+                            static_cast<uint8_t>((ignoreCase && IsLowerAsciiLetter(c)) ? 0x20 : 0)};
+    }
+
+#if defined(__AVX2__)
+#define HAVE_SIMD_KERNEL
+    struct TSimdKernel
+    {
+        static const size_t BLOCK_SIZE = 32;
+        static const size_t MASK_BITS_PER_BYTE = 1;
+
+        static __m256i MatchBytes(const char* p, const TByteMatcher& m)
+        {
+            auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            block = _mm256_or_si256(block, _mm256_set1_epi8(m.FoldMask));
+            return _mm256_cmpeq_epi8(block, _mm256_set1_epi8(m.Value));
+        }
+
+        //! Returns a mask of positions in a block where the first and the last pattern bytes match
+        static uint64_t GetCandidates(const char* first,
+                                      const char* last,
+                                      const TByteMatcher& f,
+                                      const TByteMatcher& l)
+        {
+            auto eq = _mm256_and_si256(MatchBytes(first, f), MatchBytes(last, l));
+            return static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+        }
+    };
+#elif defined(__SSE2__)
+#define HAVE_SIMD_KERNEL
+    struct TSimdKernel
+    {
+        static const size_t BLOCK_SIZE = 16;
+        static const size_t MASK_BITS_PER_BYTE = 1;
+
+        static __m128i MatchBytes(const char* p, const TByteMatcher& m)
+        {
+            auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            block = _mm_or_si128(block, _mm_set1_epi8(m.FoldMask));
+            return _mm_cmpeq_epi8(block, _mm_set1_epi8(m.Value));
+        }
+
+        static uint64_t GetCandidates(const char* first,
+                                      const char* last,
+                                      const TByteMatcher& f,
+                                      const TByteMatcher& l)
+        {
+            auto eq = _mm_and_si128(MatchBytes(first, f), MatchBytes(last, l));
+            return static_cast<uint32_t>(_mm_movemask_epi8(eq));
+        }
+    };
+#elif defined(__ARM_NEON)
+#define HAVE_SIMD_KERNEL
+    struct TSimdKernel
+    {
+        static const size_t BLOCK_SIZE = 16;
+        // NEON has no movemask, comparison result is narrowed to 4 bits per byte
+        static const size_t MASK_BITS_PER_BYTE = 4;
+
+        static uint8x16_t MatchBytes(const char* p, const TByteMatcher& m)
+        {
+            auto block = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+            block = vorrq_u8(block, vdupq_n_u8(m.FoldMask));
+            return vceqq_u8(block, vdupq_n_u8(m.Value));
+        }
+
+        static uint64_t GetCandidates(const char* first,
+                                      const char* last,
+                                      const TByteMatcher& f,
+                                      const TByteMatcher& l)
+        {
+            auto eq = vandq_u8(MatchBytes(first, f), MatchBytes(last, l));
+            auto narrowed = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+            return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+        }
+    };
+#endif
+
+#ifdef HAVE_SIMD_KERNEL
+    template<bool IgnoreCase>
+    const char* FindSubstringSimd(const char* text, size_t size, const char* pattern, size_t patternSize)
+    {
+        if (patternSize == 0) {
+            return text;
+        }
+        if (size < patternSize) {
+            return nullptr;
+        }
+        const auto BLOCK_SIZE = TSimdKernel::BLOCK_SIZE;
+        const auto MASK_BITS_PER_BYTE = TSimdKernel::MASK_BITS_PER_BYTE;
+        auto first = MakeByteMatcher(pattern[0], IgnoreCase);
+        auto last = MakeByteMatcher(pattern[patternSize - 1], IgnoreCase);
+        size_t i = 0;
+        // The last pattern byte is compared with a block ending at (i + patternSize - 1 + BLOCK_SIZE)
+        for (; i + patternSize - 1 + BLOCK_SIZE <= size; i += BLOCK_SIZE) {
+            auto candidates = TSimdKernel::GetCandidates(text + i, text + i + patternSize - 1, first, last);
+            while (candidates) {
+                auto bit = __builtin_ctzll(candidates);
+                auto p = text + i + bit / MASK_BITS_PER_BYTE;
+                // The first and the last bytes are already compared
+                if (patternSize <= 2 || EqualsPattern<IgnoreCase>(p + 1, pattern + 1, patternSize - 2)) {
+                    return p;
+                }
+                candidates &= ~(((uint64_t(1) << MASK_BITS_PER_BYTE) - 1) << (bit - bit % MASK_BITS_PER_BYTE));
+            }
+        }
+        return FindSubstringScalar<IgnoreCase>(text + i, size - i, pattern, patternSize);
+    }
+#endif
+}
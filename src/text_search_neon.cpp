@@ -0,0 +1,21 @@
+#ifdef HAVE_NEON_DISPATCH
+
+#ifndef __ARM_NEON
+#error "text_search_neon.cpp must be built with NEON enabled"
+#endif
+
+#include "text_search.h"
+
+#include "text_search_kernel.h"
+
+const char* FindSubstringNeon(const char* text, size_t size, const char* pattern, size_t patternSize)
+{
+    return FindSubstringSimd<false>(text, size, pattern, patternSize);
+}
+
+const char* FindSubstringIgnoreAsciiCaseNeon(const char* text, size_t size, const char* pattern, size_t patternSize)
+{
+    return FindSubstringSimd<true>(text, size, pattern, patternSize);
+}
+
+#endif
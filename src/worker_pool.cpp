@@ -0,0 +1,64 @@
+#include "worker_pool.h"
+
+#include "log.h"
+
+#include <wblib/utils.h>
+
+#define LOG(logger) ::logger.Log() << "[workers] "
+
+TWorkerPool::TWorkerPool(const std::string& name, size_t threadsCount, size_t maxQueueSize)
+    : MaxQueueSize(maxQueueSize),
+      Stopped(false)
+{
+    for (size_t i = 0; i < threadsCount; ++i) {
+        Threads.emplace_back([this, name] { Run(name); });
+    }
+}
+
+TWorkerPool::~TWorkerPool()
+{
+    {
+        std::unique_lock<std::mutex> lk(Mutex);
+        Stopped = true;
+        Tasks.clear();
+    }
+    TaskAdded.notify_all();
+    for (auto& thread: Threads) {
+        thread.join();
+    }
+}
+
+bool TWorkerPool::Post(TTask task)
+{
+    {
+        std::unique_lock<std::mutex> lk(Mutex);
+        if (Tasks.size() >= MaxQueueSize) {
+            return false;
+        }
+        Tasks.push_back(std::move(task));
+    }
+    TaskAdded.notify_one();
+    return true;
+}
+
+void TWorkerPool::Run(const std::string& name)
+{
+    WBMQTT::SetThreadName(name);
+    while (true) {
+        TTask task;
+        {
+            std::unique_lock<std::mutex> lk(Mutex);
+            TaskAdded.wait(lk, [this] { return Stopped || !Tasks.empty(); });
+            if (Stopped) {
+                return;
+            }
+            task = std::move(Tasks.front());
+            Tasks.pop_front();
+        }
+        try {
+            task();
+        } catch (const std::exception& e) {
+            LOG(Error) << e.what();
+        }
+    }
+}
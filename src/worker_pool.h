@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Fixed set of threads executing tasks from a bounded queue
+class TWorkerPool
+{
+public:
+    typedef std::function<void()> TTask;
+
+    /**
+     * @brief Starts worker threads
+     *
+     * @param name name of worker threads
+     * @param threadsCount number of worker threads
+     * @param maxQueueSize maximum number of tasks waiting for a free worker
+     */
+    TWorkerPool(const std::string& name, size_t threadsCount, size_t maxQueueSize);
+
+    //! Waits for running tasks, queued tasks are dropped
+    ~TWorkerPool();
+
+    TWorkerPool(const TWorkerPool&) = delete;
+    TWorkerPool& operator=(const TWorkerPool&) = delete;
+
+    //! Queues a task. Returns false if the queue is full
+    bool Post(TTask task);
+
+private:
+    void Run(const std::string& name);
+
+    std::mutex Mutex;
+    std::condition_variable TaskAdded;
+    std::deque<TTask> Tasks;
+    size_t MaxQueueSize;
+    bool Stopped;
+    std::vector<std::thread> Threads;
+};